@@ -0,0 +1,29 @@
+if (MAKE_BENCHMARKS)
+  message(STATUS "Making benchmarks")
+
+  set(BENCH_BIN_DIR "${CMAKE_BINARY_DIR}/bench")
+
+  list(APPEND BENCH_LIBRARIES
+      skull-lib
+  )
+
+  list(APPEND BENCH_INCLUDE_DIRS "${SRC_DIR}")
+
+  # Benchmark sources, one executable each
+  list(APPEND BENCHMARKS
+    ${BENCH_DIR}/bench_contention.cpp
+    ${BENCH_DIR}/bench_durability.cpp
+    ${BENCH_DIR}/bench_json.cpp
+    ${BENCH_DIR}/bench_msgpack.cpp
+    ${BENCH_DIR}/bench_parser.cpp
+    ${BENCH_DIR}/bench_strands.cpp
+  )
+
+  foreach(BENCHMARK ${BENCHMARKS})
+    get_filename_component(BENCH_NAME ${BENCHMARK} NAME_WE)
+    add_executable(${BENCH_NAME} ${BENCHMARK})
+    target_link_libraries(${BENCH_NAME} PRIVATE ${BENCH_LIBRARIES})
+    target_include_directories(${BENCH_NAME} PRIVATE ${BENCH_INCLUDE_DIRS})
+    set_target_properties(${BENCH_NAME} PROPERTIES RUNTIME_OUTPUT_DIRECTORY "${BENCH_BIN_DIR}")
+  endforeach()
+endif()
@@ -10,6 +10,9 @@ set(CMAKE_C_STANDARD_REQUIRED ON)
 # Test enabler
 option(MAKE_TESTS "make tests" ON)
 
+# Benchmark enabler
+option(MAKE_BENCHMARKS "make benchmarks" OFF)
+
 # Set release by default
 if (NOT CMAKE_BUILD_TYPE)
   set(CMAKE_BUILD_TYPE Release)
@@ -55,6 +58,7 @@ set(EXT_DIR "${CMAKE_SOURCE_DIR}/ext")
 set(LIB_DIR "${CMAKE_SOURCE_DIR}/lib")
 set(INC_DIR "${CMAKE_SOURCE_DIR}/inc")
 set(TEST_DIR "${CMAKE_SOURCE_DIR}/test")
+set(BENCH_DIR "${CMAKE_SOURCE_DIR}/bench")
 set(LIB_INSTALL_DIR "${CMAKE_BINARY_DIR}/lib")
 
 # User aditional findpackage prefixes
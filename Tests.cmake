@@ -16,8 +16,14 @@ if (MAKE_TESTS)
 
   # Test sources
   list(APPEND TESTS
+    ${TEST_DIR}/test_chunk_pool.cpp
+    ${TEST_DIR}/test_compression.cpp
+    ${TEST_DIR}/test_format.cpp
     ${TEST_DIR}/test_models.cpp
+    ${TEST_DIR}/test_parser.cpp
+    ${TEST_DIR}/test_rollup.cpp
     ${TEST_DIR}/test_server.cpp
+    ${TEST_DIR}/test_storage.cpp
   )
 
   # Test executable
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "fixture.hpp"
+
+namespace {
+  constexpr const auto ENTRIES = 50000;
+  constexpr const auto READERS = 4;
+  constexpr const auto WRITERS = 2;
+  constexpr const auto DURATION = std::chrono::seconds{3};
+  constexpr const auto USER = "bench-contention";
+
+  // Stands in for a slow client by stalling every few values written
+  class SlowSink {
+  private:
+    std::ostringstream mBuffer;
+    std::size_t mWrites{0};
+
+  public:
+    template <typename V>
+    SlowSink & operator<<(V && value) {
+      mBuffer << std::forward<V>(value);
+      if (++mWrites % 1024 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds{50});
+      }
+      return *this;
+    }
+  };
+}
+
+int main() {
+  spdlog::set_level(spdlog::level::warn);
+
+  std::vector<double> latencies;
+  std::atomic<std::size_t> reads{0};
+
+  {
+    const bench::ScratchRoot root;
+    root.createUser(USER);
+    Storage storage{root.path()};
+    bench::start(storage);
+
+    const User user{USER};
+    const auto pin = storage.pin(user);
+    for (auto i = 0; i < ENTRIES; ++i) {
+      bench::addOccurrence(storage, user, 1, 1600000000000L + i);
+    }
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+
+    for (auto i = 0; i < READERS; ++i) {
+      threads.emplace_back([&] {
+        while (running) {
+          SlowSink sink;
+          storage.stream<Occurrence>(user, sink);
+          ++reads;
+        }
+      });
+    }
+
+    std::mutex latencyMutex;
+    for (auto i = 0; i < WRITERS; ++i) {
+      threads.emplace_back([&, i] {
+        std::vector<double> local;
+        auto millis = 1700000000000L + i * 100000000L;
+        while (running) {
+          const auto start = std::chrono::steady_clock::now();
+          bench::addOccurrence(storage, user, 2, millis++);
+          local.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+          std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+
+        std::lock_guard lock{latencyMutex};
+        latencies.insert(latencies.end(), local.cbegin(), local.cend());
+      });
+    }
+
+    std::this_thread::sleep_for(DURATION);
+    running = false;
+    for (auto & thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << READERS << " readers, " << WRITERS << " writers: " << reads << " reads, " << latencies.size()
+            << " writes, write p50 " << latencies[latencies.size() / 2] << " us, p99 "
+            << latencies[latencies.size() * 99 / 100] << " us, max " << latencies.back() << " us" << std::endl;
+  return 0;
+}
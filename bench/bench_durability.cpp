@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "fixture.hpp"
+
+namespace {
+  constexpr const auto WRITES = 2000;
+  constexpr const auto USER = "bench-durability";
+
+  void measure(const char * name, Durability durability) {
+    std::vector<double> latencies;
+    latencies.reserve(WRITES);
+
+    {
+      const bench::ScratchRoot root;
+      root.createUser(USER);
+      Storage storage{root.path()};
+      bench::start(storage, durability);
+
+      const User user{USER};
+      const auto pin = storage.pin(user);
+      for (auto i = 0; i < WRITES; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        bench::addOccurrence(storage, user, 1, 1600000000000L + i);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+      }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << ": p50 " << latencies[latencies.size() / 2] << " us, p99 "
+              << latencies[latencies.size() * 99 / 100] << " us" << std::endl;
+  }
+}
+
+int main() {
+  spdlog::set_level(spdlog::level::warn);
+
+  measure("none", Durability::None);
+  measure("interval", Durability::Interval);
+  measure("every-write", Durability::EveryWrite);
+  return 0;
+}
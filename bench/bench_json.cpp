@@ -0,0 +1,70 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "format.hpp"
+#include "model.hpp"
+
+namespace {
+  constexpr const auto OCCURRENCES = 100'000;
+  constexpr const auto ROUNDS = 20;
+
+  // The std::stringstream path that the writer replaced
+  std::string legacy(const std::vector<Occurrence> & occurrences) {
+    std::stringstream output;
+    output << '[';
+    for (const auto & occurrence : occurrences) {
+      output << format::json{occurrence} << ',';
+    }
+    output << ']';
+    return output.str();
+  }
+
+  std::string current(const std::vector<Occurrence> & occurrences) {
+    std::size_t size{2};
+    for (const auto & occurrence : occurrences) {
+      size += format::jsonSize(occurrence) + 1;
+    }
+
+    format::writer output;
+    output.reserve(size);
+    output << '[';
+    for (const auto & occurrence : occurrences) {
+      output << format::json{occurrence} << ',';
+    }
+    output << ']';
+    return output.release();
+  }
+
+  template <typename F>
+  void measure(const char * name, const std::vector<Occurrence> & occurrences, F && function) {
+    std::size_t bytes{0};
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < ROUNDS; ++i) {
+      bytes += function(occurrences).size();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ": " << OCCURRENCES << " occurrences in " << elapsed * 1000 / ROUNDS << " ms ("
+              << bytes / elapsed / 1024 / 1024 << " MB/s)" << std::endl;
+  }
+}
+
+int main() {
+  std::vector<Occurrence> occurrences;
+  occurrences.reserve(OCCURRENCES);
+  for (auto i = 0; i < OCCURRENCES; ++i) {
+    occurrences.emplace_back(i + 1, i % 20 + 1, 0.25f * (i % 13 + 1), 1600000000000L + i * 60000L);
+  }
+
+  if (legacy(occurrences) != current(occurrences)) {
+    std::cerr << "Outputs differ" << std::endl;
+    return 1;
+  }
+
+  measure("stringstream", occurrences, legacy);
+  measure("writer", occurrences, current);
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "compression.hpp"
+#include "format.hpp"
+#include "model.hpp"
+
+namespace {
+  constexpr const auto OCCURRENCES = 100'000;
+  constexpr const auto ROUNDS = 20;
+
+  std::string json(const std::vector<Occurrence> & occurrences) {
+    std::size_t size{2};
+    for (const auto & occurrence : occurrences) {
+      size += format::jsonSize(occurrence) + 1;
+    }
+
+    format::writer output;
+    output.reserve(size);
+    output << '[';
+    for (const auto & occurrence : occurrences) {
+      output << format::json{occurrence} << ',';
+    }
+    output << ']';
+    return output.release();
+  }
+
+  std::string msgpack(const std::vector<Occurrence> & occurrences) {
+    format::counter size;
+    format::pack::array(size, occurrences.size());
+    for (const auto & occurrence : occurrences) {
+      size << format::msgpack{occurrence};
+    }
+
+    format::writer output;
+    output.reserve(size.size());
+    format::pack::array(output, occurrences.size());
+    for (const auto & occurrence : occurrences) {
+      output << format::msgpack{occurrence};
+    }
+    return output.release();
+  }
+
+  template <typename F>
+  void measure(const char * name, const std::vector<Occurrence> & occurrences, F && function) {
+    std::string body;
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < ROUNDS; ++i) {
+      body = function(occurrences);
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const auto gzip = compression::compress(body, compression::Encoding::Gzip, 6);
+
+    std::cout << name << ": " << OCCURRENCES << " occurrences in " << elapsed * 1000 / ROUNDS << " ms, "
+              << body.size() << " bytes (" << gzip.size() << " gzipped)" << std::endl;
+  }
+}
+
+int main() {
+  std::vector<Occurrence> occurrences;
+  occurrences.reserve(OCCURRENCES);
+  for (auto i = 0; i < OCCURRENCES; ++i) {
+    occurrences.emplace_back(i + 1, i % 20 + 1, 0.25f * (i % 13 + 1), 1600000000000L + i * 60000L);
+  }
+
+  measure("json", occurrences, json);
+  measure("msgpack", occurrences, msgpack);
+  return 0;
+}
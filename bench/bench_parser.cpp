@@ -0,0 +1,72 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "parser.hpp"
+
+namespace {
+  constexpr const auto LINES = 1'000'000;
+
+  // The getline + std::sto* path that the parser replaced
+  std::size_t legacy(const std::string & buffer) {
+    std::size_t count{0};
+    std::istringstream input{buffer};
+    std::string line;
+    while (std::getline(input, line)) {
+      std::string_view view{line};
+      std::array<std::string_view, Occurrence::size> fields;
+      std::size_t index{0};
+      for (auto i = 0; i < Occurrence::size - 1; ++i) {
+        auto next = view.find('\t', index);
+        fields[i] = view.substr(index, next - index);
+        index = next + 1;
+      }
+      fields[Occurrence::size - 1] = view.substr(index);
+
+      Occurrence occurrence{static_cast<unsigned short>(std::stoi(std::string{fields[0]})),
+                            static_cast<unsigned short>(std::stoi(std::string{fields[1]})),
+                            std::stof(std::string{fields[2]}),
+                            std::stol(std::string{fields[3]})};
+      count += occurrence.id() > 0;
+    }
+    return count;
+  }
+
+  std::size_t current(const std::string & buffer) {
+    std::size_t count{0};
+    parser::forEachLine(buffer, [&](std::string_view line, std::size_t) {
+      std::size_t column;
+      auto occurrence = parser::parse<Occurrence>(line, column);
+      count += occurrence && occurrence->id() > 0;
+    });
+    return count;
+  }
+
+  template <typename F>
+  void measure(const char * name, const std::string & buffer, F && function) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto count = function(buffer);
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ": " << count << " rows in " << elapsed * 1000 << " ms ("
+              << buffer.size() / elapsed / 1024 / 1024 << " MB/s)" << std::endl;
+  }
+}
+
+int main() {
+  std::ostringstream output;
+  for (auto i = 0; i < LINES; ++i) {
+    Occurrence{static_cast<unsigned short>(i % 65535 + 1),
+               static_cast<unsigned short>(i % 17 + 1),
+               (i % 100) / 4.0f,
+               1600000000000L + i * 60000L}.tsv(output) << '\n';
+  }
+  const auto buffer = output.str();
+
+  measure("getline + sto*", buffer, legacy);
+  measure("parser", buffer, current);
+  return 0;
+}
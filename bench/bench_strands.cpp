@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "dispatcher.hpp"
+#include "fixture.hpp"
+
+namespace {
+  constexpr const auto USERS = 8;
+  constexpr const auto THREADS = 4;
+  constexpr const auto OPERATIONS = 20000;
+  constexpr const auto SEED_ENTRIES = 200;
+  // One in this many operations is a write, the rest are reads
+  constexpr const auto WRITE_RATIO = 4;
+  constexpr const auto PREFIX = "user-";
+
+  class Latch {
+  private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::size_t mCount;
+
+  public:
+    explicit Latch(std::size_t count) : mCount{count} {}
+
+    void countDown() {
+      std::lock_guard lock{mMutex};
+      if (--mCount == 0) mCondition.notify_all();
+    }
+
+    void wait() {
+      std::unique_lock lock{mMutex};
+      mCondition.wait(lock, [this] { return mCount == 0; });
+    }
+  };
+
+  // Posts a mixed load spread over every user and reports throughput and the time
+  // each operation took once it started running
+  template <typename P>
+  void run(const char * mode, Storage & storage, const std::vector<User> & users, P && post) {
+    std::mt19937 random{42};
+    std::uniform_int_distribution<std::size_t> pick{0, users.size() - 1};
+    std::vector<double> latencies(OPERATIONS);
+    Latch latch{OPERATIONS};
+    std::atomic<long> millis{1700000000000L};
+
+    const auto begin = std::chrono::steady_clock::now();
+    for (auto i = 0; i < OPERATIONS; ++i) {
+      const auto & user = users[pick(random)];
+      post(user, [&, i] {
+        const auto start = std::chrono::steady_clock::now();
+        if (i % WRITE_RATIO == 0) {
+          bench::addOccurrence(storage, user, 1, millis++);
+        } else {
+          const auto json = storage.get<Occurrence>(user);
+          if (json.empty()) std::cerr << "Empty response" << std::endl;
+        }
+
+        latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        latch.countDown();
+      });
+    }
+    latch.wait();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << mode << ": " << static_cast<std::size_t>(OPERATIONS / elapsed) << " ops/s, p50 "
+              << latencies[latencies.size() / 2] << " us, p99 " << latencies[latencies.size() * 99 / 100] << " us"
+              << std::endl;
+  }
+
+  template <typename P>
+  void measure(const char * mode, P && post) {
+    // Every mode gets its own freshly seeded users so that runs see the same data
+    const bench::ScratchRoot root;
+    std::vector<std::string> names;
+    for (auto i = 0; i < USERS; ++i) {
+      root.createUser(names.emplace_back(std::string{PREFIX} + std::to_string(i)));
+    }
+
+    Storage storage{root.path()};
+    bench::start(storage);
+
+    std::vector<User> users;
+    std::vector<Storage::Pin> pins;
+    for (const auto & name : names) {
+      const auto & user = users.emplace_back(name);
+      pins.emplace_back(storage.pin(user));
+      for (auto i = 0; i < SEED_ENTRIES; ++i) {
+        bench::addOccurrence(storage, user, 1, 1600000000000L + i);
+      }
+    }
+
+    run(mode, storage, users, post);
+  }
+}
+
+int main() {
+  spdlog::set_level(spdlog::level::warn);
+
+  for (const auto perUser : {false, true}) {
+    Dispatcher dispatcher{THREADS, 1, perUser};
+    measure(perUser ? "strand" : "mutex", [&dispatcher](const User & user, auto && work) {
+      // Back off while the queue is full, like a client would on 503
+      while (!dispatcher.dispatch(user, work)) {
+        std::this_thread::yield();
+      }
+    });
+  }
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "storage.hpp"
+
+namespace bench {
+  // A data root of its own in the temporary directory, removed on the way out. Declared
+  // before the storage so that the writer is joined before the files go away
+  class ScratchRoot {
+  private:
+    const boost::filesystem::path mPath{boost::filesystem::temp_directory_path()
+                                        / boost::filesystem::unique_path("skull-bench-%%%%-%%%%-%%%%")};
+
+  public:
+    ScratchRoot() {
+      boost::filesystem::create_directories(mPath);
+    }
+
+    ~ScratchRoot() {
+      boost::filesystem::remove_all(mPath);
+    }
+
+    ScratchRoot(const ScratchRoot &) = delete;
+    ScratchRoot & operator=(const ScratchRoot &) = delete;
+
+    std::string path() const {
+      return mPath.string();
+    }
+
+    // Storage only finds the users present when it is constructed
+    void createUser(const std::string & name) const {
+      boost::filesystem::create_directories(mPath / name);
+      std::ofstream{(mPath / name / constant::file::SKULL).string()};
+    }
+  };
+
+  // Users are loaded on demand within the budget, when they are pinned
+  inline void start(Storage & storage, Durability durability = Durability::None) {
+    storage.start(std::size_t{1} << 30, durability);
+  }
+
+  inline void addOccurrence(Storage & storage, const User & user, std::uint32_t skull, long millis) {
+    storage.add(user, Occurrence{storage.nextId<Occurrence>(user), skull, 1.0f, millis});
+  }
+}
@@ -0,0 +1,47 @@
+#include "chunk_pool.hpp"
+
+#include "constants.hpp"
+
+ChunkPool::ChunkPool(std::size_t chunkSize, std::size_t capacity)
+    : mChunkSize{chunkSize},
+      mCapacity{capacity} {
+  mFree.reserve(capacity);
+}
+
+std::string ChunkPool::acquire() {
+  {
+    std::lock_guard lock{mMutex};
+    if (!mFree.empty()) {
+      auto buffer = std::move(mFree.back());
+      mFree.pop_back();
+      return buffer;
+    }
+  }
+
+  std::string buffer;
+  buffer.reserve(mChunkSize);
+  return buffer;
+}
+
+void ChunkPool::release(std::string && buffer) {
+  // Buffers that grew past a chunk, for an oversized value, are not worth keeping
+  if (buffer.capacity() < mChunkSize || buffer.capacity() > 2 * mChunkSize) return;
+
+  buffer.clear();
+  std::lock_guard lock{mMutex};
+  if (mFree.size() < mCapacity) {
+    mFree.emplace_back(std::move(buffer));
+  }
+}
+
+std::shared_ptr<std::string> ChunkPool::share(std::string && buffer) {
+  return std::shared_ptr<std::string>(new std::string(std::move(buffer)), [this](std::string * shared) {
+    release(std::move(*shared));
+    delete shared;
+  });
+}
+
+ChunkPool & ChunkPool::responses() {
+  static auto * const pool = new ChunkPool{constant::server::CHUNK_SIZE, constant::server::MAX_POOLED_CHUNKS};
+  return *pool;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Recycles the buffers that chunked responses are serialized into. A chunk is handed to
+// the connection without copying and comes back once it has been written
+class ChunkPool {
+private:
+  const std::size_t mChunkSize;
+  const std::size_t mCapacity;
+  std::mutex mMutex;
+  std::vector<std::string> mFree;
+
+public:
+  ChunkPool(std::size_t chunkSize, std::size_t capacity);
+
+  ChunkPool(const ChunkPool &) = delete;
+  ChunkPool & operator=(const ChunkPool &) = delete;
+
+  // Empty, with room for a whole chunk
+  [[nodiscard]] std::string acquire();
+
+  // Takes back a buffer that was not shared
+  void release(std::string && buffer);
+
+  // Hands a buffer over to whoever writes it, it returns to the pool with the last reference
+  [[nodiscard]] std::shared_ptr<std::string> share(std::string && buffer);
+
+  // Shared by every response, never destroyed so that late writes can still return buffers
+  static ChunkPool & responses();
+};
@@ -0,0 +1,123 @@
+#include "compression.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace {
+  // Gzip adds 16 to the window bits, raw deflate is the zlib format which is what the
+  // deflate content coding actually means
+  int windowBits(compression::Encoding encoding) {
+    return encoding == compression::Encoding::Gzip ? MAX_WBITS + 16 : MAX_WBITS;
+  }
+
+  std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+  }
+
+  // Parses the weight of an Accept-Encoding entry, defaulting to 1
+  float quality(std::string_view parameters) {
+    const auto position = parameters.find("q=");
+    if (position == std::string_view::npos) return 1.0f;
+
+    const std::string weight{trim(parameters.substr(position + 2))};
+    return std::strtof(weight.c_str(), nullptr);
+  }
+}
+
+namespace compression {
+  Encoding negotiate(std::string_view acceptEncoding) {
+    // Negative until listed, since an explicit zero refuses the coding even with a wildcard
+    std::array<float, ENCODING_COUNT> weights{-1.0f, -1.0f, -1.0f};
+    auto wildcard = -1.0f;
+
+    while (!acceptEncoding.empty()) {
+      const auto comma = acceptEncoding.find(',');
+      auto entry = acceptEncoding.substr(0, comma);
+      acceptEncoding = comma == std::string_view::npos ? std::string_view{} : acceptEncoding.substr(comma + 1);
+
+      const auto semicolon = entry.find(';');
+      const auto coding = trim(entry.substr(0, semicolon));
+      const auto weight = semicolon == std::string_view::npos ? 1.0f : quality(entry.substr(semicolon + 1));
+
+      if (coding == "gzip" || coding == "x-gzip") {
+        weights[static_cast<std::size_t>(Encoding::Gzip)] = weight;
+      } else if (coding == "deflate") {
+        weights[static_cast<std::size_t>(Encoding::Deflate)] = weight;
+      } else if (coding == "*") {
+        wildcard = weight;
+      }
+    }
+
+    // Gzip is preferred on ties since it is the most widely supported
+    for (const auto encoding : {Encoding::Gzip, Encoding::Deflate}) {
+      auto & weight = weights[static_cast<std::size_t>(encoding)];
+      if (weight < 0.0f) weight = wildcard;
+    }
+
+    const auto gzip = weights[static_cast<std::size_t>(Encoding::Gzip)];
+    const auto deflate = weights[static_cast<std::size_t>(Encoding::Deflate)];
+    if (gzip > 0.0f && gzip >= deflate) return Encoding::Gzip;
+    if (deflate > 0.0f) return Encoding::Deflate;
+    return Encoding::Identity;
+  }
+
+  const char * name(Encoding encoding) {
+    switch (encoding) {
+      case Encoding::Gzip: return "gzip";
+      case Encoding::Deflate: return "deflate";
+      case Encoding::Identity:
+      default: return "identity";
+    }
+  }
+
+  std::string compress(std::string_view input, Encoding encoding, int level) {
+    Stream stream{encoding, level};
+    return stream.push(input, true);
+  }
+
+  Stream::Stream(Encoding encoding, int level) : mStream{std::make_unique<z_stream>()} {
+    if (deflateInit2(mStream.get(), level, Z_DEFLATED, windowBits(encoding), 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error{"Could not initialize compression"};
+    }
+  }
+
+  Stream::~Stream() {
+    if (mStream) deflateEnd(mStream.get());
+  }
+
+  Stream::Stream(Stream && other) noexcept = default;
+
+  std::string Stream::push(std::string_view input, bool finish) {
+    std::string output;
+    push(input, finish, output);
+    return output;
+  }
+
+  void Stream::push(std::string_view input, bool finish, std::string & output) {
+    const auto start = output.size();
+    output.resize(start + deflateBound(mStream.get(), input.size()) + 16);
+
+    mStream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    mStream->avail_in = static_cast<uInt>(input.size());
+
+    auto written = start;
+    int result;
+    do {
+      if (written == output.size()) output.resize(output.size() * 2);
+      mStream->next_out = reinterpret_cast<Bytef *>(output.data() + written);
+      mStream->avail_out = static_cast<uInt>(output.size() - written);
+
+      result = deflate(mStream.get(), finish ? Z_FINISH : Z_SYNC_FLUSH);
+      written = output.size() - mStream->avail_out;
+    } while (mStream->avail_out == 0 || (finish && result == Z_OK));
+
+    if (result == Z_STREAM_ERROR) throw std::runtime_error{"Compression failed"};
+
+    output.resize(written);
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct z_stream_s;
+
+namespace compression {
+  enum class Encoding : std::uint8_t {
+    Identity = 0,
+    Gzip = 1,
+    Deflate = 2,
+  };
+
+  constexpr const std::size_t ENCODING_COUNT = 3;
+  constexpr const int MAX_LEVEL = 9;
+
+  // Picks the preferred encoding listed in an Accept-Encoding header, honouring q=0
+  Encoding negotiate(std::string_view acceptEncoding);
+
+  // Value for the Content-Encoding header
+  const char * name(Encoding encoding);
+
+  std::string compress(std::string_view input, Encoding encoding, int level);
+
+  // Compresses a body that is produced piece by piece, such as chunked output
+  class Stream {
+  private:
+    std::unique_ptr<z_stream_s> mStream;
+
+  public:
+    Stream(Encoding encoding, int level);
+    ~Stream();
+
+    Stream(Stream &&) noexcept;
+    Stream(const Stream &) = delete;
+    Stream & operator=(const Stream &) = delete;
+    Stream & operator=(Stream &&) = delete;
+
+    // Returns whatever compressed output is ready. Once finished, no more input is taken
+    std::string push(std::string_view input, bool finish);
+
+    // Same as above, appending to output so that its buffer can be reused
+    void push(std::string_view input, bool finish, std::string & output);
+  };
+}
@@ -1,10 +1,27 @@
 #pragma once
 
+#include <chrono>
+
 #include "user.hpp"
 
 namespace constant {
   namespace server {
     constexpr const auto MAX_BUFFER = 64 * 1024;
+    constexpr const std::size_t MAX_QUEUED = 4096;
+    // Larger bodies are streamed in chunks rather than built and cached in memory
+    constexpr const std::size_t MAX_BODY = 32 * 1024 * 1024;
+    // Chunks are sent once they reach MAX_BUFFER, the rest is room for the value that crossed it
+    constexpr const std::size_t CHUNK_SIZE = MAX_BUFFER + 4 * 1024;
+    constexpr const std::size_t MAX_POOLED_CHUNKS = 64;
+    // Chunks a response may have waiting on its connection, the next is produced once one
+    // of them was written
+    constexpr const std::size_t MAX_INFLIGHT_CHUNKS = 4;
+    // Connections whose writes make no progress for this long are closed
+    constexpr const auto WRITE_TIMEOUT = std::chrono::seconds{30};
+    // Zlib level, zero disables compression
+    constexpr const auto COMPRESSION_LEVEL = 6;
+    // Smaller bodies are not worth the header and the time
+    constexpr const std::size_t COMPRESSION_MINIMUM = 1024;
   }
 
   namespace path {
@@ -12,6 +29,8 @@ namespace constant {
     constexpr const auto QUICK = "/quick";
     constexpr const auto OCCURRENCE = "/occurrence";
     constexpr const auto RELOAD = "/reload";
+    constexpr const auto SYNC = "/sync";
+    constexpr const auto ROLLUP = "/rollup";
   }
 
   namespace file {
@@ -19,10 +38,53 @@ namespace constant {
     constexpr const auto SKULL = "skull";
     constexpr const auto QUICK = "quick";
     constexpr const auto OCCURRENCE = "occurrence";
+
+    namespace binary {
+      constexpr const auto QUICK = "quick.bin";
+      constexpr const auto OCCURRENCE = "occurrence.bin";
+    }
+
+    namespace segment {
+      constexpr const auto OCCURRENCE = "occurrence.d";
+    }
+
+    // Where a missing segment directory is written before being renamed into place
+    namespace staging {
+      constexpr const auto OCCURRENCE = "occurrence.d.tmp";
+    }
+
+    // Legacy snapshots are renamed rather than deleted once migrated
+    namespace migrated {
+      constexpr const auto OCCURRENCE = "occurrence.migrated";
+      constexpr const auto OCCURRENCE_BINARY = "occurrence.bin.migrated";
+    }
+
+    namespace sequence {
+      constexpr const auto SKULL = "skull.sequence";
+    }
+
+    namespace journal {
+      constexpr const auto SKULL = "skull.journal";
+      constexpr const auto QUICK = "quick.journal";
+      constexpr const auto OCCURRENCE = "occurrence.journal";
+    }
+  }
+
+  namespace storage {
+    constexpr const auto COMPACTION_THRESHOLD = 1024;
+    constexpr const auto TOMBSTONE_THRESHOLD = 1024;
+    constexpr const auto MAX_PENDING = 4096;
+    // Default time the writer waits for more mutations to coalesce, zero flushes at once
+    constexpr const auto FLUSH_LATENCY = std::chrono::milliseconds{200};
+    constexpr const auto SYNC_INTERVAL = std::chrono::seconds{1};
+    constexpr const auto RELOAD_ATTEMPTS = 3;
+    // Changes kept per user for clients catching up
+    constexpr const std::size_t CHANGE_FEED_SIZE = 1024;
   }
 
   namespace header {
     constexpr const auto X_USER = "X-User";
+    constexpr const auto X_NEXT_CURSOR = "X-Next-Cursor";
   }
 
   namespace user {
@@ -40,5 +102,10 @@ namespace constant {
     constexpr const auto SKULL = "skull";
     constexpr const auto AMOUNT = "amount";
     constexpr const auto MILLIS = "millis";
+    constexpr const auto FROM = "from";
+    constexpr const auto TO = "to";
+    constexpr const auto CURSOR = "cursor";
+    constexpr const auto SINCE = "since";
+    constexpr const auto BY = "by";
   }
 }
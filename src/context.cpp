@@ -1,5 +1,9 @@
 #include "context.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
 #include <spdlog/spdlog.h>
 
 namespace {
@@ -15,6 +19,37 @@ namespace {
     }
   }
 
+  std::string_view trim(std::string_view value) {
+    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+    while (!value.empty() && value.back() == ' ') value.remove_suffix(1);
+    return value;
+  }
+
+  // Weight of the best Accept entry matching any of the media types, or -1 if none does
+  float acceptWeight(std::string_view accept, std::initializer_list<std::string_view> types) {
+    auto best = -1.0f;
+    while (!accept.empty()) {
+      const auto comma = accept.find(',');
+      const auto entry = accept.substr(0, comma);
+      accept = comma == std::string_view::npos ? std::string_view{} : accept.substr(comma + 1);
+
+      const auto semicolon = entry.find(';');
+      const auto type = trim(entry.substr(0, semicolon));
+      if (std::find(types.begin(), types.end(), type) == types.end()) continue;
+
+      auto weight = 1.0f;
+      if (semicolon != std::string_view::npos) {
+        const auto parameters = entry.substr(semicolon + 1);
+        const auto quality = parameters.find("q=");
+        if (quality != std::string_view::npos) {
+          weight = std::strtof(std::string{trim(parameters.substr(quality + 2))}.c_str(), nullptr);
+        }
+      }
+      best = std::max(best, weight);
+    }
+    return best;
+  }
+
   spdlog::level::level_enum levelForStatus(const restinio::http_status_line_t & status) {
     switch (status.status_code().raw_code() / 100) {
       case 1:
@@ -39,6 +74,20 @@ Context::Context(const restinio::request_handle_t & request)
                request->header().request_target());
 }
 
+compression::Encoding Context::acceptedEncoding() const {
+  if (!request->header().has_field(restinio::http_field::accept_encoding)) return compression::Encoding::Identity;
+  return compression::negotiate(request->header().get_field(restinio::http_field::accept_encoding));
+}
+
+bool Context::prefersMsgpack() const {
+  if (!request->header().has_field(restinio::http_field::accept)) return false;
+
+  const std::string_view accept = request->header().get_field(restinio::http_field::accept);
+  const auto msgpack = acceptWeight(accept, {"application/msgpack", "application/x-msgpack", "application/vnd.msgpack"});
+  const auto json = acceptWeight(accept, {"application/json", "text/json", "application/*", "text/*", "*/*"});
+  return msgpack > 0.0f && msgpack >= json;
+}
+
 template <>
 void Context::logDone<true>(const restinio::http_status_line_t & status) const {
   spdlog::log(levelForStatus(status),
@@ -12,12 +12,19 @@ public:
 
   Context(const restinio::request_handle_t & request);
 
+  // Preferred encoding from Accept-Encoding, identity if none is supported
+  [[nodiscard]] compression::Encoding acceptedEncoding() const;
+
+  // Whether Accept asks for MessagePack at least as strongly as for JSON
+  [[nodiscard]] bool prefersMsgpack() const;
+
   template <typename T = restinio::restinio_controlled_output_t>
   auto createResponse(restinio::http_status_line_t && status) {
     return Response{request->create_response<T>(std::move(status))
 #ifdef LOCAL_DEVELOPMENT
         .append_header(restinio::http_field::access_control_allow_origin, request->header().get_field(restinio::http_field::origin))
-        .append_header(restinio::http_field::access_control_allow_headers, "x-user")
+        .append_header(restinio::http_field::access_control_allow_headers, "x-user, if-none-match, accept, accept-encoding")
+        .append_header(restinio::http_field::access_control_expose_headers, "etag, content-encoding, x-next-cursor")
         .append_header(restinio::http_field::access_control_allow_methods, "GET, POST, PUT, DELETE, OPTIONS")
         .append_header(restinio::http_field::access_control_allow_credentials, "true"),
 #else
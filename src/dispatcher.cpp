@@ -0,0 +1,22 @@
+#include "dispatcher.hpp"
+
+Dispatcher::Dispatcher(std::size_t threadCount, std::size_t deferredThreadCount, bool perUser)
+    : mPool{threadCount},
+      mDeferredPool{deferredThreadCount},
+      mPerUser{perUser} {}
+
+Dispatcher::~Dispatcher() {
+  mPool.join();
+  mDeferredPool.join();
+}
+
+Dispatcher::Strand & Dispatcher::strand(const User & user) {
+  std::lock_guard lock{mMutex};
+
+  // Nodes are stable, so the reference outlives the lock
+  auto strand = mStrands.find(user.hash);
+  if (strand == mStrands.end()) {
+    strand = mStrands.emplace(user.hash, boost::asio::make_strand(mPool)).first;
+  }
+  return strand->second;
+}
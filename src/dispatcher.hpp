@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include "constants.hpp"
+#include "user.hpp"
+
+// Runs request work off the I/O threads. Regular work goes to a shared pool, optionally
+// in order and one at a time for any given user, so that different users scale across
+// the pool without ever contending with each other. Long running work, such as large
+// exports and reloads, is deferred to a separate pool so that it cannot hold up small
+// requests. Both pools are bounded by MAX_QUEUED
+class Dispatcher {
+private:
+  using Strand = boost::asio::strand<boost::asio::thread_pool::executor_type>;
+
+  boost::asio::thread_pool mPool;
+  boost::asio::thread_pool mDeferredPool;
+  const bool mPerUser;
+  std::atomic<std::size_t> mQueued{0};
+  std::atomic<std::size_t> mDeferred{0};
+  std::mutex mMutex;
+  // Keyed by hash since request users do not own their names
+  std::unordered_map<std::size_t, Strand> mStrands;
+
+  Strand & strand(const User & user);
+
+  static bool reserve(std::atomic<std::size_t> & counter) {
+    if (counter.fetch_add(1) < constant::server::MAX_QUEUED) return true;
+    --counter;
+    return false;
+  }
+
+  template <typename E, typename F>
+  static void post(E && executor, std::atomic<std::size_t> & counter, F && work) {
+    boost::asio::post(std::forward<E>(executor), [&counter, work = std::forward<F>(work)]() mutable {
+      --counter;
+      work();
+    });
+  }
+
+public:
+  Dispatcher(std::size_t threadCount, std::size_t deferredThreadCount, bool perUser);
+  ~Dispatcher();
+
+  Dispatcher(const Dispatcher &) = delete;
+  Dispatcher & operator=(const Dispatcher &) = delete;
+
+  // Returns false, leaving work untouched, if too much work is already queued
+  template <typename F>
+  [[nodiscard]]
+  bool dispatch(const User & user, F && work) {
+    if (!reserve(mQueued)) return false;
+
+    if (mPerUser) {
+      post(strand(user), mQueued, std::forward<F>(work));
+    } else {
+      post(mPool.get_executor(), mQueued, std::forward<F>(work));
+    }
+    return true;
+  }
+
+  // Returns false, leaving work untouched, if too much work is already deferred
+  template <typename F>
+  [[nodiscard]]
+  bool defer(F && work) {
+    if (!reserve(mDeferred)) return false;
+
+    post(mDeferredPool.get_executor(), mDeferred, std::forward<F>(work));
+    return true;
+  }
+};
@@ -0,0 +1,23 @@
+#include "etag.hpp"
+
+namespace {
+  std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+  }
+}
+
+bool etag::matches(std::string_view ifNoneMatch, std::string_view tag) {
+  while (!ifNoneMatch.empty()) {
+    const auto comma = ifNoneMatch.find(',');
+    auto candidate = trim(ifNoneMatch.substr(0, comma));
+    ifNoneMatch = comma == std::string_view::npos ? std::string_view{} : ifNoneMatch.substr(comma + 1);
+
+    if (candidate == "*") return true;
+    if (candidate.substr(0, 2) == "W/") candidate.remove_prefix(2);
+    if (candidate == tag) return true;
+  }
+
+  return false;
+}
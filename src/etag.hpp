@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string_view>
+
+namespace etag {
+  // Whether an If-None-Match header lists the tag, weakly or not, or is a wildcard. Weak
+  // comparison is what RFC 7232 asks of If-None-Match
+  bool matches(std::string_view ifNoneMatch, std::string_view tag);
+}
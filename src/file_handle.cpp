@@ -1,14 +1,21 @@
 #include "file_handle.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
 #include <boost/filesystem.hpp>
 #include <spdlog/spdlog.h>
 
-#include "constants.hpp"
-
 template <>
-FileHandle<std::ofstream>::FileHandle(const std::string & user, const char * const fileName)
-    : path{(boost::filesystem::path{constant::file::ROOT} / user / fileName).generic_string()},
-      file{path} {
+FileHandle<std::ofstream>::FileHandle(const std::string & directory, const char * const fileName, std::ios_base::openmode mode)
+    : path{(boost::filesystem::path{directory} / fileName).generic_string()},
+      file{path, mode} {
   if (!file.good()) {
     file.close();
     spdlog::error("Failed to open {:s} for saving", path);
@@ -17,14 +24,20 @@ FileHandle<std::ofstream>::FileHandle(const std::string & user, const char * con
 
 template <>
 FileHandle<std::ofstream>::~FileHandle() {
-  if (file.is_open()) spdlog::info("Updated {:s}", path);
+  if (!file.is_open()) return;
+
   file.close();
+  if (file.fail()) {
+    spdlog::error("Failed to write {:s}", path);
+  } else {
+    spdlog::info("Updated {:s}", path);
+  }
 }
 
 template <>
-FileHandle<std::ifstream>::FileHandle(const std::string & user, const char * const fileName)
-    : path{(boost::filesystem::path{constant::file::ROOT} / user / fileName).generic_string()},
-      file{path} {
+FileHandle<std::ifstream>::FileHandle(const std::string & directory, const char * const fileName, std::ios_base::openmode mode)
+    : path{(boost::filesystem::path{directory} / fileName).generic_string()},
+      file{path, mode} {
   if (!file.good()) {
     file.close();
     spdlog::error("Failed to open {:s} for loading", path);
@@ -37,12 +50,185 @@ FileHandle<std::ifstream>::~FileHandle() {
   file.close();
 }
 
-void UserIterator::forEach(const std::function<void(const User &)> & executor) {
-  auto root = boost::filesystem::path{constant::file::ROOT};
+template <typename T>
+bool FileHandle<T>::exists(const std::string & directory, const char * const fileName) {
+  return boost::filesystem::exists(boost::filesystem::path{directory} / fileName);
+}
+
+template <typename T>
+void FileHandle<T>::createDirectory(const std::string & directory, const char * const name) {
+  const auto path = boost::filesystem::path{directory} / name;
+  boost::system::error_code error;
+  boost::filesystem::create_directories(path, error);
+  if (error) {
+    spdlog::error("Failed to create {:s}: {:s}", path.generic_string(), error.message());
+  }
+}
+
+template <typename T>
+void FileHandle<T>::remove(const std::string & directory, const char * const fileName) {
+  const auto path = boost::filesystem::path{directory} / fileName;
+  boost::system::error_code error;
+  boost::filesystem::remove_all(path, error);
+  if (error) {
+    spdlog::error("Failed to remove {:s}: {:s}", path.generic_string(), error.message());
+  }
+}
+
+template <typename T>
+bool FileHandle<T>::rename(const std::string & directory, const char * const from, const char * const to, bool durable) {
+  const boost::filesystem::path root{directory};
+  if (::rename((root / from).c_str(), (root / to).c_str()) != 0) {
+    spdlog::error("Failed to rename {:s} to {:s} in {:s}", from, to, directory);
+    return false;
+  }
+
+  return !durable || sync(directory);
+}
+
+template <typename T>
+bool FileHandle<T>::sync(const std::string & path) {
+  auto descriptor = ::open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    spdlog::error("Failed to open {:s} for syncing", path);
+    return false;
+  }
+
+  const auto synced = ::fsync(descriptor) == 0;
+  ::close(descriptor);
+
+  if (!synced) {
+    spdlog::error("Failed to sync {:s}", path);
+  }
+  return synced;
+}
+
+template bool FileHandle<std::ifstream>::exists(const std::string &, const char * const);
+template bool FileHandle<std::ofstream>::exists(const std::string &, const char * const);
+template void FileHandle<std::ofstream>::createDirectory(const std::string &, const char * const);
+template void FileHandle<std::ofstream>::remove(const std::string &, const char * const);
+template bool FileHandle<std::ofstream>::rename(const std::string &, const char * const, const char * const, bool);
+template bool FileHandle<std::ofstream>::sync(const std::string &);
+
+SnapshotHandle::SnapshotHandle(const std::string & directory, const char * const fileName, std::ios_base::openmode mode)
+    : path{(boost::filesystem::path{directory} / fileName).generic_string()},
+      temporary{path + ".tmp"},
+      file{temporary, mode} {
+  if (!file.good()) {
+    file.close();
+    spdlog::error("Failed to open {:s} for saving", temporary);
+  }
+}
+
+SnapshotHandle::~SnapshotHandle() {
+  if (committed) return;
+
+  file.close();
+  boost::system::error_code error;
+  boost::filesystem::remove(temporary, error);
+}
+
+bool SnapshotHandle::commit(bool durable) {
+  file.close();
+  if (file.fail()) {
+    spdlog::error("Failed to write {:s}", temporary);
+    return false;
+  }
+
+  if (durable && !FileHandle<std::ofstream>::sync(temporary)) return false;
+
+  if (::rename(temporary.c_str(), path.c_str()) != 0) {
+    spdlog::error("Failed to replace {:s}", path);
+    return false;
+  }
+
+  committed = true;
+  if (durable) {
+    FileHandle<std::ofstream>::sync(boost::filesystem::path{path}.parent_path().generic_string());
+  }
+
+  spdlog::info("Updated {:s}", path);
+  return true;
+}
 
+void SnapshotHandle::discard(const std::string & directory, const char * const name) {
+  const auto root = boost::filesystem::path{directory} / name;
+  if (!boost::filesystem::is_directory(root)) return;
+
+  std::vector<boost::filesystem::path> temporaries;
+  for (auto it{boost::filesystem::directory_iterator{root}}; it != boost::filesystem::directory_iterator{}; ++it) {
+    if (!boost::filesystem::is_regular_file(it->status()) || it->path().extension() != ".tmp") continue;
+    temporaries.emplace_back(it->path());
+  }
+
+  for (const auto & temporary : temporaries) {
+    boost::system::error_code error;
+    boost::filesystem::remove(temporary, error);
+    if (error) {
+      spdlog::error("Failed to remove {:s}: {:s}", temporary.generic_string(), error.message());
+    } else {
+      spdlog::info("Removed {:s}", temporary.generic_string());
+    }
+  }
+}
+
+MappedFile::MappedFile(const std::string & directory, const char * const fileName)
+    : path{(boost::filesystem::path{directory} / fileName).generic_string()} {
+  auto descriptor = ::open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    spdlog::error("Failed to open {:s} for mapping", path);
+    return;
+  }
+
+  struct stat status{};
+  if (::fstat(descriptor, &status) == 0) {
+    if (status.st_size == 0) {
+      open = true;
+    } else {
+      auto mapped = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (mapped != MAP_FAILED) {
+        ::madvise(mapped, status.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(mapped);
+        size = status.st_size;
+        open = true;
+      }
+    }
+  }
+  ::close(descriptor);
+
+  if (!good()) {
+    spdlog::error("Failed to map {:s}", path);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (!good()) return;
+
+  if (data != nullptr) ::munmap(const_cast<char *>(data), size);
+  spdlog::info("Loaded {:s}", path);
+}
+
+void UserIterator::forEach(const std::string & root, const std::function<void(const User &)> & executor) {
   for (auto it{boost::filesystem::directory_iterator{root}}; it != boost::filesystem::directory_iterator{}; ++it) {
     auto user = it->path().filename().generic_string();
     spdlog::info("Found user: {:s}", user);
     executor(user);
   }
 }
+
+void SegmentIterator::forEach(const std::string & directory,
+                              const char * const segments,
+                              const std::function<void(const std::string &)> & executor) {
+  const auto root = boost::filesystem::path{directory} / segments;
+
+  std::vector<std::string> names;
+  for (auto it{boost::filesystem::directory_iterator{root}}; it != boost::filesystem::directory_iterator{}; ++it) {
+    if (!boost::filesystem::is_regular_file(it->status())) continue;
+    names.emplace_back(it->path().filename().generic_string());
+  }
+
+  std::sort(names.begin(), names.end());
+  for (const auto & segment : names) {
+    executor((boost::filesystem::path{segments} / segment).generic_string());
+  }
+}
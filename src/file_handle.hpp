@@ -1,9 +1,23 @@
 #pragma once
 
+#include <fstream>
+#include <functional>
+#include <string>
+
 #include "user.hpp"
 
+// Paths below are relative to the directory of a user, given first
+
 struct UserIterator {
-  static void forEach(const std::function<void(const User &)> & executor);
+  // Visits the users of a data root
+  static void forEach(const std::string & root, const std::function<void(const User &)> & executor);
+};
+
+struct SegmentIterator {
+  // Visits the files of a user's segment directory in lexicographic order
+  static void forEach(const std::string & directory,
+                      const char * const segments,
+                      const std::function<void(const std::string &)> & executor);
 };
 
 template <typename T>
@@ -11,7 +25,7 @@ struct FileHandle {
   const std::string path;
   T file;
 
-  FileHandle(const std::string & user, const char * const fileName);
+  FileHandle(const std::string & directory, const char * const fileName, std::ios_base::openmode mode = {});
   virtual ~FileHandle();
 
   FileHandle(const FileHandle &) = delete;
@@ -20,7 +34,59 @@ struct FileHandle {
   inline bool good() const {
     return file.good();
   }
+
+  static bool exists(const std::string & directory, const char * const fileName);
+  static void createDirectory(const std::string & directory, const char * const name);
+  // Removes files and directories alike, along with their contents
+  static void remove(const std::string & directory, const char * const fileName);
+  // Replaces to with from, syncing the user's directory afterwards if durable
+  static bool rename(const std::string & directory, const char * const from, const char * const to, bool durable);
+  static bool sync(const std::string & path);
+};
+
+// Writes to a temporary file which only replaces the target once committed, so that a
+// crash mid-write never leaves a partial snapshot behind
+struct SnapshotHandle {
+  const std::string path;
+  const std::string temporary;
+  std::ofstream file;
+
+  SnapshotHandle(const std::string & directory, const char * const fileName, std::ios_base::openmode mode = {});
+  ~SnapshotHandle();
+
+  SnapshotHandle(const SnapshotHandle &) = delete;
+  SnapshotHandle & operator=(const SnapshotHandle &) = delete;
+
+  inline bool good() const {
+    return file.good();
+  }
+
+  bool commit(bool durable);
+
+  // Removes the temporary files left in a user's directory by snapshots never committed
+  static void discard(const std::string & directory, const char * const name);
+
+private:
+  bool committed{false};
 };
 
+struct MappedFile {
+  const std::string path;
+  const char * data{nullptr};
+  std::size_t size{0};
+  bool open{false};
+
+  MappedFile(const std::string & directory, const char * const fileName);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
 
+  inline bool good() const {
+    return open;
+  }
 
+  inline std::string_view view() const {
+    return {data, size};
+  }
+};
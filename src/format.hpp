@@ -1,5 +1,14 @@
 #pragma once
 
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <fmt/format.h>
+
 namespace format {
   template <typename T>
   struct json {
@@ -24,4 +33,349 @@ namespace format {
       return self.value.tsv(stream);
     }
   };
+
+  template <typename T>
+  struct binary {
+    const T & value;
+
+    binary(const T & value) : value{value} {}
+
+    template <typename S>
+    friend S & operator<<(S & stream, const binary & self) {
+      return self.value.binary(stream);
+    }
+  };
+
+  // MessagePack, each value as an array of its fields in declaration order
+  template <typename T>
+  struct msgpack {
+    const T & value;
+
+    msgpack(const T & value) : value{value} {}
+
+    template <typename S>
+    friend S & operator<<(S & stream, const msgpack & self) {
+      return self.value.msgpack(stream);
+    }
+  };
+
+  // MessagePack primitives, always in their smallest encoding
+  namespace pack {
+    template <typename S, typename T>
+    inline void bigEndian(S & stream, T value) {
+      for (auto shift = static_cast<int>(sizeof(T) * 8) - 8; shift >= 0; shift -= 8) {
+        stream << static_cast<char>((value >> shift) & 0xff);
+      }
+    }
+
+    template <typename S>
+    inline void array(S & stream, std::size_t size) {
+      if (size < 16) {
+        stream << static_cast<char>(0x90 | size);
+      } else if (size <= 0xffff) {
+        stream << '\xdc';
+        bigEndian(stream, static_cast<std::uint16_t>(size));
+      } else {
+        stream << '\xdd';
+        bigEndian(stream, static_cast<std::uint32_t>(size));
+      }
+    }
+
+    template <typename S>
+    inline void nil(S & stream) {
+      stream << '\xc0';
+    }
+
+    template <typename S>
+    inline void integer(S & stream, std::uint64_t value) {
+      if (value < 0x80) {
+        stream << static_cast<char>(value);
+      } else if (value <= 0xff) {
+        stream << '\xcc';
+        bigEndian(stream, static_cast<std::uint8_t>(value));
+      } else if (value <= 0xffff) {
+        stream << '\xcd';
+        bigEndian(stream, static_cast<std::uint16_t>(value));
+      } else if (value <= 0xffffffff) {
+        stream << '\xce';
+        bigEndian(stream, static_cast<std::uint32_t>(value));
+      } else {
+        stream << '\xcf';
+        bigEndian(stream, value);
+      }
+    }
+
+    template <typename S>
+    inline void integer(S & stream, std::int64_t value) {
+      if (value >= 0) {
+        integer(stream, static_cast<std::uint64_t>(value));
+      } else if (value >= -32) {
+        stream << static_cast<char>(value);
+      } else if (value >= INT8_MIN) {
+        stream << '\xd0';
+        bigEndian(stream, static_cast<std::uint8_t>(value));
+      } else if (value >= INT16_MIN) {
+        stream << '\xd1';
+        bigEndian(stream, static_cast<std::uint16_t>(value));
+      } else if (value >= INT32_MIN) {
+        stream << '\xd2';
+        bigEndian(stream, static_cast<std::uint32_t>(value));
+      } else {
+        stream << '\xd3';
+        bigEndian(stream, static_cast<std::uint64_t>(value));
+      }
+    }
+
+    template <typename S>
+    inline void real(S & stream, float value) {
+      std::uint32_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      stream << '\xca';
+      bigEndian(stream, bits);
+    }
+
+    template <typename S>
+    inline void string(S & stream, std::string_view value) {
+      if (value.size() < 32) {
+        stream << static_cast<char>(0xa0 | value.size());
+      } else if (value.size() <= 0xff) {
+        stream << '\xd9';
+        bigEndian(stream, static_cast<std::uint8_t>(value.size()));
+      } else if (value.size() <= 0xffff) {
+        stream << '\xda';
+        bigEndian(stream, static_cast<std::uint16_t>(value.size()));
+      } else {
+        stream << '\xdb';
+        bigEndian(stream, static_cast<std::uint32_t>(value.size()));
+      }
+      stream << value;
+    }
+  }
+
+  // Fixed-width snapshot header. Records follow in native byte order
+  struct binaryHeader {
+    static constexpr const char MAGIC[4] = {'S', 'K', 'B', 'N'};
+
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    // Next id to allocate, zero for types without ids or snapshots that predate it
+    std::uint32_t sequence;
+
+    template <typename T>
+    static constexpr binaryHeader of(std::uint32_t sequence = 0) {
+      return {{MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3]}, T::version, sizeof(typename T::Record), sequence};
+    }
+
+    template <typename R>
+    inline bool matches(std::uint32_t expected) const {
+      return std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && version == expected && recordSize == sizeof(R);
+    }
+
+    template <typename T>
+    inline bool matches() const {
+      return matches<typename T::Record>(T::version);
+    }
+  };
+
+  // JSON string contents, escaping quotes, backslashes and control characters
+  struct escaped {
+    std::string_view value;
+
+    escaped(std::string_view value) : value{value} {}
+
+    template <typename S>
+    friend S & operator<<(S & stream, const escaped & self) {
+      static constexpr const char HEX[] = "0123456789abcdef";
+
+      std::size_t start{0};
+      for (std::size_t i = 0; i < self.value.size(); ++i) {
+        const auto character = static_cast<unsigned char>(self.value[i]);
+        if (character >= 0x20 && character != '"' && character != '\\') continue;
+
+        stream << self.value.substr(start, i - start);
+        start = i + 1;
+        switch (character) {
+          case '"': stream << "\\\""; break;
+          case '\\': stream << "\\\\"; break;
+          case '\n': stream << "\\n"; break;
+          case '\r': stream << "\\r"; break;
+          case '\t': stream << "\\t"; break;
+          default: {
+            const char unicode[] = {'\\', 'u', '0', '0', HEX[character >> 4], HEX[character & 0xf], '\0'};
+            stream << unicode;
+          }
+        }
+      }
+
+      stream << self.value.substr(start);
+      return stream;
+    }
+  };
+
+  namespace detail {
+    inline bool fitsGeneral(const char * begin, const char * end) {
+      if (begin != end && *begin == '-') ++begin;
+
+      std::size_t integral{0};
+      std::size_t significant{0};
+      auto fraction = false;
+      for (auto cursor = begin; cursor != end; ++cursor) {
+        if (*cursor == '.') {
+          fraction = true;
+        } else if (*cursor < '0' || *cursor > '9') {
+          return false;
+        } else {
+          if (!fraction) ++integral;
+          if (significant > 0 || *cursor != '0') ++significant;
+        }
+      }
+
+      return integral <= 6 && significant <= 6;
+    }
+
+    // Floats exactly like the default iostream precision. The shortest round trip is much
+    // cheaper than {:g} and identical to it whenever it needs no more than the 6
+    // significant digits that {:g} keeps, without an exponent
+    inline char * general(float value, char (& digits)[32]) {
+      auto end = fmt::format_to(digits, FMT_STRING("{}"), value);
+      if (!fitsGeneral(digits, end)) {
+        end = fmt::format_to(digits, FMT_STRING("{:g}"), value);
+      }
+      return end;
+    }
+  }
+
+  // Append-only replacement for std::stringstream when serializing. Numbers are formatted
+  // without locales
+  class writer {
+  private:
+    std::string mBuffer;
+
+  public:
+    writer() = default;
+
+    // Writes into a recycled buffer, keeping its capacity
+    explicit writer(std::string && buffer) : mBuffer{std::move(buffer)} {
+      mBuffer.clear();
+    }
+
+    inline void reserve(std::size_t size) {
+      mBuffer.reserve(size);
+    }
+
+    inline void clear() {
+      mBuffer.clear();
+    }
+
+    [[nodiscard]]
+    inline std::string_view view() const {
+      return mBuffer;
+    }
+
+    [[nodiscard]]
+    inline std::size_t size() const {
+      return mBuffer.size();
+    }
+
+    [[nodiscard]]
+    inline std::string release() {
+      return std::move(mBuffer);
+    }
+
+    inline writer & operator<<(char value) {
+      mBuffer.push_back(value);
+      return *this;
+    }
+
+    inline writer & operator<<(std::string_view value) {
+      mBuffer.append(value.data(), value.size());
+      return *this;
+    }
+
+    inline writer & operator<<(const char * value) {
+      return *this << std::string_view{value};
+    }
+
+    inline writer & operator<<(const std::string & value) {
+      return *this << std::string_view{value};
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char>>>
+    inline writer & operator<<(T value) {
+      char digits[24];
+      const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+      mBuffer.append(digits, result.ptr);
+      return *this;
+    }
+
+    inline writer & operator<<(float value) {
+      char digits[32];
+      mBuffer.append(digits, detail::general(value, digits));
+      return *this;
+    }
+
+    // Shortest round trip, doubles only come up in aggregates
+    inline writer & operator<<(double value) {
+      fmt::format_to(std::back_inserter(mBuffer), FMT_STRING("{}"), value);
+      return *this;
+    }
+  };
+
+  // Counts what a writer would append, without storing it
+  class counter {
+  private:
+    std::size_t mSize{0};
+
+  public:
+    [[nodiscard]]
+    inline std::size_t size() const {
+      return mSize;
+    }
+
+    inline counter & operator<<(char) {
+      ++mSize;
+      return *this;
+    }
+
+    inline counter & operator<<(std::string_view value) {
+      mSize += value.size();
+      return *this;
+    }
+
+    inline counter & operator<<(const char * value) {
+      return *this << std::string_view{value};
+    }
+
+    inline counter & operator<<(const std::string & value) {
+      return *this << std::string_view{value};
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char>>>
+    inline counter & operator<<(T value) {
+      char digits[24];
+      mSize += std::to_chars(digits, digits + sizeof(digits), value).ptr - digits;
+      return *this;
+    }
+
+    inline counter & operator<<(float value) {
+      char digits[32];
+      mSize += detail::general(value, digits) - digits;
+      return *this;
+    }
+
+    inline counter & operator<<(double value) {
+      mSize += fmt::formatted_size(FMT_STRING("{}"), value);
+      return *this;
+    }
+  };
+
+  // Exact length of the JSON for a value
+  template <typename T>
+  [[nodiscard]]
+  inline std::size_t jsonSize(const T & value) {
+    counter output;
+    output << json<T>{value};
+    return output.size();
+  }
 }
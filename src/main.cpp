@@ -6,11 +6,35 @@ int main(int argc, char * argv[]) {
   auto aHost = mfl::args::extractOption(argc, argv, "-h");
   auto aPort = mfl::args::extractOption(argc, argv, "-p");
   auto aThreadCount = mfl::args::extractOption(argc, argv, "-t");
+  auto aBackgroundLoad = mfl::args::extractOption(argc, argv, "-b");
+  auto aMemoryBudget = mfl::args::extractOption(argc, argv, "-m");
+  auto aDurability = mfl::args::extractOption(argc, argv, "-d");
+  auto aFlushLatency = mfl::args::extractOption(argc, argv, "-f");
+  auto aUserStrands = mfl::args::extractOption(argc, argv, "-s");
+  auto aCompressionLevel = mfl::args::extractOption(argc, argv, "-z");
+  auto aCompressionMinimum = mfl::args::extractOption(argc, argv, "-Z");
 
   std::string host{aHost ? aHost : "localhost"};
   std::uint16_t port{static_cast<uint16_t>(aPort ? std::strtol(aPort, nullptr, 0) : 8080)};
   std::uint16_t threadCount{static_cast<uint16_t>(aThreadCount ? std::strtol(aThreadCount, nullptr, 0) : 4)};
+  bool backgroundLoad{aBackgroundLoad ? std::strtol(aBackgroundLoad, nullptr, 0) != 0 : false};
+  std::size_t memoryBudget{aMemoryBudget ? std::strtoul(aMemoryBudget, nullptr, 0) * 1024 * 1024 : 0};
+  std::uint8_t durability{static_cast<uint8_t>(aDurability ? std::strtol(aDurability, nullptr, 0) : 1)};
+  std::chrono::milliseconds flushLatency{aFlushLatency
+                                         ? std::chrono::milliseconds{std::strtoul(aFlushLatency, nullptr, 0)}
+                                         : constant::storage::FLUSH_LATENCY};
+  bool userStrands{aUserStrands ? std::strtol(aUserStrands, nullptr, 0) != 0 : false};
+  std::uint8_t compressionLevel{static_cast<uint8_t>(aCompressionLevel
+                                                     ? std::strtol(aCompressionLevel, nullptr, 0)
+                                                     : constant::server::COMPRESSION_LEVEL)};
+  std::size_t compressionMinimum{aCompressionMinimum
+                                 ? std::strtoul(aCompressionMinimum, nullptr, 0)
+                                 : constant::server::COMPRESSION_MINIMUM};
 
-  server::listen(std::move(host), port, threadCount);
+  server::listen(std::move(host), port, threadCount, backgroundLoad, memoryBudget, durability,
+                 flushLatency,
+                 userStrands,
+                 compressionLevel,
+                 compressionMinimum);
   return 0;
 }
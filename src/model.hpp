@@ -1,51 +1,59 @@
 #pragma once
 
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
-#include <limits>
+#include <optional>
 #include <string>
+#include <string_view>
+
+#include "format.hpp"
 
 namespace {
   template<typename T>
-  T stot(std::string_view string);
-
-  template<>
-  unsigned short stot<unsigned short>(std::string_view string) {
-    std::string buffer{string};
-    auto integer = std::stoi(buffer);
-    if (integer < 0) {
-      throw std::runtime_error{"underflow"};
-    }
-    if (integer > std::numeric_limits<unsigned short>::max()) {
-      throw std::runtime_error{"overflow"};
-    }
-    return static_cast<unsigned short>(integer);
+  bool stot(std::string_view string, T & value) {
+    const auto end = string.data() + string.size();
+    const auto result = std::from_chars(string.data(), end, value);
+    return result.ec == std::errc{} && result.ptr == end;
   }
 
+  // std::from_chars for floating point is not available on every supported toolchain
   template<>
-  long stot<long>(std::string_view string) {
-    std::string buffer{string};
-    return std::stol(buffer);
-  }
+  bool stot<float>(std::string_view string, float & value) {
+    char buffer[32];
+    if (string.empty() || string.size() >= sizeof(buffer)) return false;
 
-  template<>
-  float stot<float>(std::string_view string) {
-    std::string buffer{string};
-    return std::stof(buffer);
+    std::memcpy(buffer, string.data(), string.size());
+    buffer[string.size()] = '\0';
+
+    char * end;
+    errno = 0;
+    value = std::strtof(buffer, &end);
+    return errno == 0 && end == buffer + string.size();
   }
 
   template<typename T>
-  std::optional<T> fromOptional(std::string_view optionalString) {
+  bool fromOptional(std::string_view optionalString, std::optional<T> & value) {
     if (optionalString.empty() || (optionalString.size() == 1 && optionalString[0] == '_')) {
-      return std::nullopt;
+      value = std::nullopt;
+      return true;
     }
 
-    return stot<T>(optionalString);
+    T parsed;
+    if (!stot(optionalString, parsed)) return false;
+
+    value = parsed;
+    return true;
   }
 }
 
 class Skull {
 private:
-  unsigned short mId;
+  std::uint32_t mId;
   std::string mName;
   std::string mColor;
   std::string mIcon;
@@ -61,7 +69,7 @@ public:
   Skull & operator=(Skull &&) = default;
 
   template <typename A, typename B, typename C>
-  Skull(unsigned short id, A && name, B && color, C && icon, float unitPrice, std::optional<float> limit = {})
+  Skull(std::uint32_t id, A && name, B && color, C && icon, float unitPrice, std::optional<float> limit = {})
       : mId{id},
         mName{std::forward<A>(name)},
         mColor{std::forward<B>(color)},
@@ -69,16 +77,27 @@ public:
         mUnitPrice{unitPrice},
         mLimit{limit} {}
 
-  Skull(std::array<std::string_view, size> params)
-      : mId{stot<unsigned short>(params[0])},
-        mName{params[1]},
-        mColor{params[2]},
-        mIcon{params[3]},
-        mUnitPrice{stot<float>(params[4])},
-        mLimit{fromOptional<float>(params[5])} {}
+  // Copies are explicit so that they only happen where intended
+  [[nodiscard]]
+  inline Skull clone() const {
+    return Skull{mId, mName, mColor, mIcon, mUnitPrice, mLimit};
+  }
+
+  // On failure, field holds the index of the offending parameter
+  static std::optional<Skull> parse(const std::array<std::string_view, size> & params, std::size_t & field) {
+    std::uint32_t id;
+    float unitPrice;
+    std::optional<float> limit;
+
+    if (!stot(params[field = 0], id)) return {};
+    if (!stot(params[field = 4], unitPrice)) return {};
+    if (!fromOptional(params[field = 5], limit)) return {};
+
+    return std::make_optional<Skull>(id, params[1], params[2], params[3], unitPrice, limit);
+  }
 
   [[nodiscard]]
-  inline const unsigned short & id() const {
+  inline const std::uint32_t & id() const {
     return mId;
   }
 
@@ -118,9 +137,9 @@ public:
   template <typename T>
   inline T & json(T & stream) const {
     stream << R"({"id":)" << mId
-           << R"(,"name":")" << mName << '"'
-           << R"(,"color":")" << mColor << '"'
-           << R"(,"icon":")" << mIcon << '"'
+           << R"(,"name":")" << format::escaped{mName} << '"'
+           << R"(,"color":")" << format::escaped{mColor} << '"'
+           << R"(,"icon":")" << format::escaped{mIcon} << '"'
            << R"(,"unitPrice":)" << mUnitPrice;
 
     if (mLimit.has_value()) {
@@ -147,31 +166,83 @@ public:
 
     return stream;
   }
+
+  template <typename T>
+  inline T & msgpack(T & stream) const {
+    format::pack::array(stream, 6);
+    format::pack::integer(stream, std::uint64_t{mId});
+    format::pack::string(stream, mName);
+    format::pack::string(stream, mColor);
+    format::pack::string(stream, mIcon);
+    format::pack::real(stream, mUnitPrice);
+
+    if (mLimit.has_value()) {
+      format::pack::real(stream, mLimit.value());
+    } else {
+      format::pack::nil(stream);
+    }
+
+    return stream;
+  }
 };
 
 struct Quick {
 private:
-  unsigned short mSkull;
+  std::uint32_t mSkull;
   float mAmount;
 
 public:
   static constexpr const auto size = 2;
+  static constexpr const std::uint32_t version = 2;
+
+  struct Record {
+    std::uint32_t skull;
+    float amount;
+  };
+
+  // Layout of version 1 snapshots, migrated on load
+  static constexpr const std::uint32_t legacyVersion = 1;
+
+  struct LegacyRecord {
+    std::uint16_t skull;
+    std::uint16_t reserved;
+    float amount;
+  };
 
   Quick(const Quick &) = delete;
   Quick(Quick &&) = default;
   Quick & operator=(const Quick &) = delete;
   Quick & operator=(Quick &&) = default;
 
-  Quick(unsigned short skull, float amount)
+  Quick(std::uint32_t skull, float amount)
       : mSkull{skull},
         mAmount{amount} {}
 
-  Quick(std::array<std::string_view, size> params)
-      : mSkull{stot<unsigned short>(params[0])},
-        mAmount{stot<float>(params[1])} {}
+  [[nodiscard]]
+  inline Quick clone() const {
+    return Quick{mSkull, mAmount};
+  }
+
+  static std::optional<Quick> parse(const std::array<std::string_view, size> & params, std::size_t & field) {
+    std::uint32_t skull;
+    float amount;
+
+    if (!stot(params[field = 0], skull)) return {};
+    if (!stot(params[field = 1], amount)) return {};
+
+    return std::make_optional<Quick>(skull, amount);
+  }
+
+  Quick(const Record & record)
+      : mSkull{record.skull},
+        mAmount{record.amount} {}
+
+  Quick(const LegacyRecord & record)
+      : mSkull{record.skull},
+        mAmount{record.amount} {}
 
   [[nodiscard]]
-  inline const unsigned short & skull() const {
+  inline const std::uint32_t & skull() const {
     return mSkull;
   }
 
@@ -201,25 +272,59 @@ public:
     stream << mSkull << '\t' << mAmount;
     return stream;
   }
+
+  template <typename T>
+  inline T & msgpack(T & stream) const {
+    format::pack::array(stream, 2);
+    format::pack::integer(stream, std::uint64_t{mSkull});
+    format::pack::real(stream, mAmount);
+    return stream;
+  }
+
+  template <typename T>
+  inline T & binary(T & stream) const {
+    const Record record{mSkull, mAmount};
+    stream.write(reinterpret_cast<const char *>(&record), sizeof(Record));
+    return stream;
+  }
 };
 
 struct Occurrence {
 private:
-  unsigned short mId;
-  unsigned short mSkull;
+  std::uint32_t mId;
+  std::uint32_t mSkull;
   float mAmount;
   long mMillis;
 
 public:
   static constexpr const auto size = 4;
+  static constexpr const std::uint32_t version = 2;
+
+  struct Record {
+    std::int64_t millis;
+    float amount;
+    std::uint32_t id;
+    std::uint32_t skull;
+    std::uint32_t reserved;
+  };
+
+  // Layout of version 1 snapshots, migrated on load
+  static constexpr const std::uint32_t legacyVersion = 1;
+
+  struct LegacyRecord {
+    std::int64_t millis;
+    float amount;
+    std::uint16_t id;
+    std::uint16_t skull;
+  };
 
   Occurrence(const Occurrence &) = delete;
   Occurrence(Occurrence &&) = default;
   Occurrence & operator=(const Occurrence &) = delete;
   Occurrence & operator=(Occurrence &&) = default;
 
-  Occurrence(unsigned short id,
-             unsigned short skull,
+  Occurrence(std::uint32_t id,
+             std::uint32_t skull,
              float amount,
              long millis)
       : mId{id},
@@ -227,19 +332,44 @@ public:
         mAmount{amount},
         mMillis{millis} {}
 
-  Occurrence(std::array<std::string_view, size> params)
-      : mId{stot<unsigned short>(params[0])},
-        mSkull{stot<unsigned short>(params[1])},
-        mAmount{stot<float>(params[2])},
-        mMillis{stot<long>(params[3])} {}
+  [[nodiscard]]
+  inline Occurrence clone() const {
+    return Occurrence{mId, mSkull, mAmount, mMillis};
+  }
+
+  static std::optional<Occurrence> parse(const std::array<std::string_view, size> & params, std::size_t & field) {
+    std::uint32_t id;
+    std::uint32_t skull;
+    float amount;
+    long millis;
+
+    if (!stot(params[field = 0], id)) return {};
+    if (!stot(params[field = 1], skull)) return {};
+    if (!stot(params[field = 2], amount)) return {};
+    if (!stot(params[field = 3], millis)) return {};
+
+    return std::make_optional<Occurrence>(id, skull, amount, millis);
+  }
+
+  Occurrence(const Record & record)
+      : mId{record.id},
+        mSkull{record.skull},
+        mAmount{record.amount},
+        mMillis{record.millis} {}
+
+  Occurrence(const LegacyRecord & record)
+      : mId{record.id},
+        mSkull{record.skull},
+        mAmount{record.amount},
+        mMillis{record.millis} {}
 
   [[nodiscard]]
-  inline const unsigned short & id() const {
+  inline const std::uint32_t & id() const {
     return mId;
   }
 
   [[nodiscard]]
-  inline const unsigned short & skull() const {
+  inline const std::uint32_t & skull() const {
     return mSkull;
   }
 
@@ -279,4 +409,21 @@ public:
            << mMillis;
     return stream;
   }
+
+  template <typename T>
+  inline T & msgpack(T & stream) const {
+    format::pack::array(stream, 4);
+    format::pack::integer(stream, std::uint64_t{mId});
+    format::pack::integer(stream, std::uint64_t{mSkull});
+    format::pack::real(stream, mAmount);
+    format::pack::integer(stream, std::int64_t{mMillis});
+    return stream;
+  }
+
+  template <typename T>
+  inline T & binary(T & stream) const {
+    const Record record{mMillis, mAmount, mId, mSkull, 0};
+    stream.write(reinterpret_cast<const char *>(&record), sizeof(Record));
+    return stream;
+  }
 };
@@ -0,0 +1,33 @@
+#include "parser.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace parser {
+  const char * find(const char * begin, const char * end, char delimiter) noexcept {
+#ifdef __AVX2__
+    const auto wideNeedle = _mm256_set1_epi8(delimiter);
+    for (; end - begin >= 32; begin += 32) {
+      const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+      const auto mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, wideNeedle));
+      if (mask != 0) return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+    }
+#endif
+
+#ifdef __SSE2__
+    const auto needle = _mm_set1_epi8(delimiter);
+    for (; end - begin >= 16; begin += 16) {
+      const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+      const auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+      if (mask != 0) return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+    }
+#endif
+
+    for (; begin != end; ++begin) {
+      if (*begin == delimiter) return begin;
+    }
+
+    return end;
+  }
+}
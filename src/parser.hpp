@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string_view>
+
+namespace parser {
+  // Returns the first occurrence of delimiter in [begin, end), or end if there is none
+  const char * find(const char * begin, const char * end, char delimiter) noexcept;
+
+  template <typename F>
+  void forEachLine(std::string_view buffer, F && consumer) {
+    std::size_t number{0};
+    auto cursor = buffer.data();
+    const auto end = cursor + buffer.size();
+
+    while (cursor < end) {
+      const auto next = find(cursor, end, '\n');
+      ++number;
+
+      std::string_view line{cursor, static_cast<std::size_t>(next - cursor)};
+      if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+      if (!line.empty()) consumer(line, number);
+
+      if (next == end) break;
+      cursor = next + 1;
+    }
+  }
+
+  // On failure, column holds the 1-based position of the offending field
+  template <typename T>
+  std::optional<T> parse(std::string_view line, std::size_t & column) {
+    std::array<std::string_view, T::size> fields;
+
+    auto cursor = line.data();
+    const auto end = cursor + line.size();
+    for (std::size_t i = 0; i < T::size - 1; ++i) {
+      const auto next = find(cursor, end, '\t');
+      if (next == end) {
+        column = line.size() + 1;
+        return {};
+      }
+
+      fields[i] = {cursor, static_cast<std::size_t>(next - cursor)};
+      cursor = next + 1;
+    }
+
+    const auto trailing = find(cursor, end, '\t');
+    if (trailing != end) {
+      column = trailing - line.data() + 1;
+      return {};
+    }
+
+    fields[T::size - 1] = {cursor, static_cast<std::size_t>(end - cursor)};
+
+    std::size_t field{0};
+    auto value = T::parse(fields, field);
+    if (!value) {
+      column = fields[field].data() - line.data() + 1;
+    }
+
+    return value;
+  }
+}
@@ -1,16 +1,147 @@
 #pragma once
 
-#include <sstream>
+#include <memory>
+#include <mutex>
+#include <optional>
 
+#include <spdlog/spdlog.h>
+
+#include "chunk_pool.hpp"
+#include "compression.hpp"
 #include "constants.hpp"
+#include "format.hpp"
 
 template <typename T, typename C>
 class Response {
   friend class Context;
 
+  static constexpr const auto chunked = std::is_same_v<T, restinio::chunked_output_t>;
+
+  // A chunked body on its way out, owned by the write callbacks. Each written chunk makes
+  // room for the next one, which is produced through schedule, so that a slow client holds
+  // up neither a thread nor more than MAX_INFLIGHT_CHUNKS of the body
+  template <typename P, typename S>
+  class Body : public std::enable_shared_from_this<Body<P, S>> {
+  private:
+    restinio::response_builder_t<T> response;
+    std::optional<compression::Stream> compressor;
+    P produce;
+    S schedule;
+    format::writer buffer{ChunkPool::responses().acquire()};
+    // Guards the flags below, the rest is only touched by pump, which never runs twice at once
+    std::mutex mutex;
+    std::size_t inflight{0};
+    bool scheduled{true};
+    bool produced{false};
+    bool failed{false};
+
+    // Moves the buffer into the connection without copying, it returns to the pool once
+    // written. False if there was nothing to send yet
+    bool sendChunk(bool last) {
+      auto & pool = ChunkPool::responses();
+      std::string chunk;
+      if (compressor) {
+        chunk = pool.acquire();
+        compressor->push(buffer.view(), last, chunk);
+        buffer.clear();
+      } else {
+        chunk = buffer.release();
+        buffer = last ? format::writer{} : format::writer{pool.acquire()};
+      }
+
+      // An empty chunk would end the body
+      if (chunk.empty()) {
+        pool.release(std::move(chunk));
+        return false;
+      }
+
+      response.append_chunk(pool.share(std::move(chunk)));
+      response.flush([body = this->shared_from_this()](const auto & error) { body->written(error); });
+      return true;
+    }
+
+    template <typename E>
+    void written(const E & error) {
+      {
+        std::lock_guard lock{mutex};
+        --inflight;
+        if (error) {
+          // restinio already closed the connection, which is also how stalled writes end
+          // once they exceed the server's write time limit
+          if (!failed) spdlog::warn("Stopped streaming a response: {:s}", error.message());
+          failed = true;
+          return;
+        }
+        if (produced || scheduled) return;
+        scheduled = true;
+      }
+
+      schedule([body = this->shared_from_this()] { body->pump(); });
+    }
+
+    // Ends the exchange without finishing the body, since that would pass it off as
+    // complete. restinio closes a connection once nothing refers to it anymore
+    void abort() {
+      {
+        std::lock_guard lock{mutex};
+        failed = true;
+      }
+      [[maybe_unused]] const auto dropped = std::move(response);
+    }
+
+  public:
+    Body(restinio::response_builder_t<T> && response, std::optional<compression::Stream> && compressor, P produce, S schedule)
+        : response{std::move(response)},
+          compressor{std::move(compressor)},
+          produce{std::move(produce)},
+          schedule{std::move(schedule)} {}
+
+    ~Body() {
+      ChunkPool::responses().release(buffer.release());
+    }
+
+    Body(const Body &) = delete;
+    Body & operator=(const Body &) = delete;
+
+    // Sends chunks until enough are in flight, and finishes the response after the last
+    void pump() {
+      try {
+        while (true) {
+          {
+            std::lock_guard lock{mutex};
+            if (failed || inflight >= constant::server::MAX_INFLIGHT_CHUNKS) {
+              scheduled = false;
+              return;
+            }
+            ++inflight;
+          }
+
+          const auto last = produce(buffer, static_cast<std::size_t>(constant::server::MAX_BUFFER));
+          if (last) {
+            std::lock_guard lock{mutex};
+            produced = true;
+          }
+
+          if (!sendChunk(last)) {
+            std::lock_guard lock{mutex};
+            --inflight;
+          }
+
+          if (last) {
+            response.done();
+            return;
+          }
+        }
+      } catch (const std::exception & e) {
+        spdlog::error("Exception while streaming a response: {:s}", e.what());
+        abort();
+      }
+    }
+  };
+
   restinio::response_builder_t<T> response;
   const C callback;
-  std::stringstream buffer{};
+  std::optional<compression::Stream> compressor{};
 
   Response(restinio::response_builder_t<T> && response, C && callback)
       : response{std::move(response)},
@@ -31,6 +162,11 @@ public:
     return std::move(*this);
   }
 
+  inline Response & appendHeader(std::string && field, std::string && value) & {
+    response.append_header(std::move(field), std::move(value));
+    return *this;
+  }
+
   inline Response && setBody(restinio::writable_item_t body) && {
     response.set_body(std::move(body));
     return std::move(*this);
@@ -41,51 +177,59 @@ public:
     return std::move(*this);
   }
 
+  // Compresses every chunk from here on, the encoding is usually the one the client accepted
+  inline Response && compress(compression::Encoding encoding, int level) && {
+    static_assert(chunked);
+    response.append_header(restinio::http_field::vary, "accept-encoding");
+    if (encoding != compression::Encoding::Identity && level > 0) {
+      response.append_header(restinio::http_field::content_encoding, compression::name(encoding));
+      compressor.emplace(encoding, level);
+    }
+    return std::move(*this);
+  }
+
   inline Response && appendChunk(restinio::writable_item_t chunk) && {
-    static_assert(std::is_same_v<T, restinio::chunked_output_t>);
+    static_assert(chunked);
     response.append_chunk(std::move(chunk));
     return std::move(*this);
   }
 
   inline Response && flush() && {
-    static_assert(std::is_same_v<T, restinio::chunked_output_t>);
+    static_assert(chunked);
     response.flush();
     return std::move(*this);
   }
 
   inline Response & appendChunk(restinio::writable_item_t chunk) & {
-    static_assert(std::is_same_v<T, restinio::chunked_output_t>);
+    static_assert(chunked);
     response.append_chunk(std::move(chunk));
     return *this;
   }
 
   inline Response & flush() & {
-    static_assert(std::is_same_v<T, restinio::chunked_output_t>);
+    static_assert(chunked);
     response.flush();
     return *this;
   }
 
   inline restinio::request_handling_status_t done() {
-    if constexpr (std::is_same_v<T, restinio::chunked_output_t>) {
-      if (buffer.tellp() >= 0) {
-        response.append_chunk(buffer.str());
-      }
-    }
-
     callback(response.header().status_line());
     return response.done();
   }
 
-  template <typename V>
-  friend inline Response & operator<<(Response<T, C> & response, V && value) {
-    static_assert(std::is_same_v<T, restinio::chunked_output_t>);
-    response.buffer << std::forward<V>(value);
-    if (response.buffer.tellp() > constant::server::MAX_BUFFER) {
-      response.response.append_chunk(response.buffer.str());
-      response.response.flush();
-      response.buffer.str(std::string{});
-    }
+  // Sends the body a chunk at a time as produce(buffer, limit) appends it, which returns
+  // true once the body is complete. The first chunks are produced right away, later ones
+  // through schedule(work) once earlier ones were written. The status is logged up front,
+  // since the request may be long gone by the time the body is
+  template <typename P, typename S>
+  inline restinio::request_handling_status_t stream(P && produce, S && schedule) && {
+    static_assert(chunked);
+    callback(response.header().status_line());
 
-    return response;
+    std::make_shared<Body<std::decay_t<P>, std::decay_t<S>>>(std::move(response),
+                                                             std::move(compressor),
+                                                             std::forward<P>(produce),
+                                                             std::forward<S>(schedule))->pump();
+    return restinio::request_accepted();
   }
 };
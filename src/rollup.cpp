@@ -0,0 +1,106 @@
+#include "rollup.hpp"
+
+namespace {
+  constexpr const long DAY = 24L * 60 * 60 * 1000;
+
+  // Rounds towards negative infinity, so that times before the epoch land in the right bucket
+  constexpr long floorDivide(long value, long divisor) {
+    return value / divisor - (value % divisor < 0 ? 1 : 0);
+  }
+
+  // Proleptic Gregorian calendar conversions from Howard Hinnant's date algorithms
+  constexpr long daysFromCivil(long year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const long era = (year >= 0 ? year : year - 399) / 400;
+    const auto yearOfEra = static_cast<unsigned>(year - era * 400);
+    const auto dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const auto dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<long>(dayOfEra) - 719468;
+  }
+
+  constexpr std::int64_t monthFromDays(long days) {
+    days += 719468;
+    const long era = (days >= 0 ? days : days - 146096) / 146097;
+    const auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const auto dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const auto shiftedMonth = (5 * dayOfYear + 2) / 153;
+    const auto month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    const auto year = static_cast<long>(yearOfEra) + era * 400 + (month <= 2);
+    return year * 12 + month - 1;
+  }
+
+  static_assert(daysFromCivil(1970, 1, 1) == 0);
+  static_assert(monthFromDays(0) == 1970 * 12);
+  static_assert(monthFromDays(daysFromCivil(2000, 2, 29)) == 2000 * 12 + 1);
+}
+
+std::int64_t Rollup::bucketOf(long millis, Granularity granularity) {
+  const auto days = floorDivide(millis, DAY);
+  switch (granularity) {
+    // The epoch was a Thursday
+    case Granularity::Week: return floorDivide(days + 3, 7);
+    case Granularity::Month: return monthFromDays(days);
+    case Granularity::Day:
+    default: return days;
+  }
+}
+
+long Rollup::startOf(std::int64_t bucket, Granularity granularity) {
+  switch (granularity) {
+    case Granularity::Week: return (bucket * 7L - 3) * DAY;
+    case Granularity::Month: {
+      const auto year = floorDivide(bucket, 12);
+      return daysFromCivil(year, static_cast<unsigned>(bucket - year * 12 + 1), 1) * DAY;
+    }
+    case Granularity::Day:
+    default: return bucket * DAY;
+  }
+}
+
+std::optional<Granularity> Rollup::parse(std::string_view granularity) {
+  if (granularity == "day") return Granularity::Day;
+  if (granularity == "week") return Granularity::Week;
+  if (granularity == "month") return Granularity::Month;
+  return {};
+}
+
+void Rollup::add(const Occurrence & occurrence) {
+  for (std::size_t i = 0; i < GRANULARITY_COUNT; ++i) {
+    auto & totals = mBuckets[i][bucketOf(occurrence.millis(), static_cast<Granularity>(i))];
+    const auto [total, created] = totals.try_emplace(occurrence.skull());
+    if (created) ++mSize;
+    total->second.amount += occurrence.amount();
+    ++total->second.count;
+  }
+}
+
+void Rollup::remove(const Occurrence & occurrence) {
+  for (std::size_t i = 0; i < GRANULARITY_COUNT; ++i) {
+    auto bucket = mBuckets[i].find(bucketOf(occurrence.millis(), static_cast<Granularity>(i)));
+    if (bucket == mBuckets[i].end()) continue;
+
+    auto total = bucket->second.find(occurrence.skull());
+    if (total == bucket->second.end()) continue;
+
+    // Dropped rather than left at a rounding error from zero
+    if (--total->second.count == 0) {
+      bucket->second.erase(total);
+      --mSize;
+      if (bucket->second.empty()) mBuckets[i].erase(bucket);
+    } else {
+      total->second.amount -= occurrence.amount();
+    }
+  }
+}
+
+void Rollup::clear() {
+  for (auto & buckets : mBuckets) {
+    buckets.clear();
+  }
+  mSize = 0;
+}
+
+std::size_t Rollup::size() const {
+  return mSize;
+}
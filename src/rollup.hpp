@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+#include "model.hpp"
+
+enum class Granularity : std::uint8_t {
+  Day = 0,
+  Week = 1,
+  Month = 2,
+};
+
+// Totals of occurrences per time bucket and skull, for every granularity at once. Kept up
+// to date on every change so that aggregating costs as many steps as there are buckets
+class Rollup {
+public:
+  struct Total {
+    double amount{0};
+    std::uint32_t count{0};
+  };
+
+private:
+  static constexpr const std::size_t GRANULARITY_COUNT = 3;
+
+  std::array<std::map<std::int64_t, std::unordered_map<std::uint32_t, Total>>, GRANULARITY_COUNT> mBuckets;
+  // Totals across every granularity
+  std::size_t mSize{0};
+
+public:
+  // Days since the epoch, weeks starting on Monday since the epoch and months since year
+  // zero, all in UTC. Wide enough for any millis, so open ranges need no clamping
+  static std::int64_t bucketOf(long millis, Granularity granularity);
+
+  // Millis at which a bucket starts
+  static long startOf(std::int64_t bucket, Granularity granularity);
+
+  static std::optional<Granularity> parse(std::string_view granularity);
+
+  void add(const Occurrence & occurrence);
+  void remove(const Occurrence & occurrence);
+  void clear();
+
+  [[nodiscard]] std::size_t size() const;
+
+  // Visits the totals of the buckets overlapping [from, to) in chronological order
+  template <typename F>
+  void forEach(Granularity granularity, long from, long to, std::optional<std::uint32_t> skull, F && function) const {
+    if (from >= to) return;
+
+    const auto & buckets = mBuckets[static_cast<std::size_t>(granularity)];
+    const auto last = bucketOf(to - 1, granularity);
+    for (auto bucket = buckets.lower_bound(bucketOf(from, granularity));
+         bucket != buckets.cend() && bucket->first <= last;
+         ++bucket) {
+      if (skull) {
+        const auto total = bucket->second.find(*skull);
+        if (total != bucket->second.cend()) function(bucket->first, total->first, total->second);
+      } else {
+        for (const auto & [id, total] : bucket->second) {
+          function(bucket->first, id, total);
+        }
+      }
+    }
+  }
+};
@@ -1,16 +1,24 @@
 #include "server.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <limits>
+
 #include <spdlog/spdlog.h>
 
+#include "dispatcher.hpp"
+#include "etag.hpp"
 #include "storage.hpp"
 
 namespace {
   Storage storage{};
-
-  struct ServerMode {
-    using SingleThread = boost::asio::executor;
-    using MultiThread = boost::asio::strand<boost::asio::executor>;
-  };
+  // Declared after storage so that queued work finishes before storage goes away
+  std::unique_ptr<Dispatcher> dispatcher;
+  struct {
+    int level{constant::server::COMPRESSION_LEVEL};
+    std::size_t minimum{constant::server::COMPRESSION_MINIMUM};
+  } compressionSettings;
 
   using ServerTraits = restinio::traits_t<restinio::asio_timer_manager_t,
       restinio::null_logger_t,
@@ -36,29 +44,288 @@ namespace {
     return fail(std::move(context), restinio::status_not_found());
   }
 
+  inline server::Handler serviceUnavailable(Context && context) noexcept {
+    return fail(std::move(context), restinio::status_service_unavailable());
+  }
+
 #ifdef LOCAL_DEVELOPMENT
   inline server::Handler emptyOk(Context && context) noexcept {
     return context.createResponse(restinio::status_ok()).done();
   }
 #endif
 
+  // Hands the request over to the workers so that I/O threads never block. Unknown users
+  // are answered right away so that arbitrary headers cannot grow the strand map
+  server::Handler dispatch(Context && context, server::Handler (* handler)(Context &&)) noexcept {
+    if (!dispatcher || !storage.authorized(context.user)) return handler(std::move(context));
+
+    try {
+      if (!dispatcher->dispatch(context.user, [context, handler]() mutable { handler(std::move(context)); })) {
+        spdlog::warn("{} Too many queued requests", context);
+        return serviceUnavailable(std::move(context));
+      }
+      return restinio::request_accepted();
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  // Tells apart versions handed out by previous runs, which also started counting at zero
+  const auto EPOCH = std::chrono::system_clock::now().time_since_epoch().count();
+
+  // Decided before the tag is computed, since every representation gets its own
+  struct Representation {
+    bool packed;
+    compression::Encoding encoding;
+  };
+
+  constexpr const auto VARY = "accept, accept-encoding";
+
+  Representation negotiate(const Context & context) {
+    return {context.prefersMsgpack(),
+            compressionSettings.level > 0 ? context.acceptedEncoding() : compression::Encoding::Identity};
+  }
+
+  template <typename T>
+  std::string entityTag(const User & user, const Representation & representation) {
+    const auto compressed = representation.encoding != compression::Encoding::Identity;
+    return fmt::format("\"{:x}-{:x}{:s}{:s}{:s}\"",
+                       EPOCH,
+                       storage.version<T>(user),
+                       representation.packed ? "-msgpack" : "",
+                       compressed ? "-" : "",
+                       compressed ? compression::name(representation.encoding) : "");
+  }
+
+  bool notModified(const Context & context, std::string_view tag) {
+    return context.request->header().has_field(restinio::http_field::if_none_match)
+           && etag::matches(context.request->header().get_field(restinio::http_field::if_none_match), tag);
+  }
+
+  // Later chunks of a streamed body are produced on the deferred pool as well, or right
+  // away on the I/O thread that wrote the previous one if the pool is full
+  void scheduleChunk(std::function<void()> && work) {
+    if (!dispatcher || !dispatcher->defer(work)) work();
+  }
+
+  // Serializes straight from a snapshot, so only a few chunks are held in memory at a time
+  template <typename T>
+  server::Handler streamValues(Context && context, std::string && tag, const Representation & representation) noexcept {
+    try {
+      return context.createResponse<restinio::chunked_output_t>(restinio::status_ok())
+          .appendHeader(restinio::http_field::content_type,
+                        representation.packed ? "application/msgpack" : "text/json; charset=utf-8")
+          .appendHeader(restinio::http_field::vary, "accept")
+          .appendHeader(restinio::http_field::etag, std::move(tag))
+          .compress(representation.encoding, compressionSettings.level)
+          .stream(Storage::Serializer<T>{storage.snapshot<T>(context.user), representation.packed}, scheduleChunk);
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  inline server::Handler sendNotModified(Context && context, std::string && tag) {
+    return context.createResponse(restinio::status_not_modified())
+        .appendHeader(restinio::http_field::vary, VARY)
+        .appendHeader(restinio::http_field::etag, std::move(tag))
+        .done();
+  }
+
+  inline auto okResponse(Context & context, std::string && tag, bool packed) {
+    return context.createResponse(restinio::status_ok())
+        .appendHeader(restinio::http_field::content_type,
+                      packed ? "application/msgpack" : "text/json; charset=utf-8")
+        .appendHeader(restinio::http_field::vary, VARY)
+        .appendHeader(restinio::http_field::etag, std::move(tag));
+  }
+
+  // Compresses on every request, for bodies that are not cached
+  template <typename R>
+  server::Handler sendBody(R && response, std::string && body, compression::Encoding encoding) {
+    if (encoding == compression::Encoding::Identity || body.size() < compressionSettings.minimum) {
+      return std::move(response).setBody(std::move(body)).done();
+    }
+
+    return std::move(response)
+        .appendHeader(restinio::http_field::content_encoding, compression::name(encoding))
+        .setBody(compression::compress(body, encoding, compressionSettings.level))
+        .done();
+  }
+
+  template <typename T>
+  server::Handler sendJson(Context && context, std::string && tag, compression::Encoding encoding) noexcept {
+    try {
+      const auto json = storage.json<T>(context.user);
+      auto response = okResponse(context, std::move(tag), false);
+
+      if (encoding == compression::Encoding::Identity || json->size() < compressionSettings.minimum) {
+        return std::move(response).setBody(json).done();
+      }
+
+      return std::move(response)
+          .appendHeader(restinio::http_field::content_encoding, compression::name(encoding))
+          .setBody(storage.compressed<T>(context.user, json, encoding, compressionSettings.level))
+          .done();
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  template <typename T>
+  server::Handler sendMsgpack(Context && context, std::string && tag, compression::Encoding encoding) noexcept {
+    try {
+      return sendBody(okResponse(context, std::move(tag), true), storage.msgpack<T>(context.user), encoding);
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  template <typename T>
+  server::Handler sendValues(Context && context, std::string && tag, const Representation & representation) noexcept {
+    // Packed values are never larger than their JSON, so its size bounds both
+    if (storage.jsonSize<T>(context.user) > constant::server::MAX_BODY
+        && (representation.packed || !storage.serialized<T>(context.user))) {
+      return streamValues<T>(std::move(context), std::move(tag), representation);
+    }
+
+    return representation.packed
+           ? sendMsgpack<T>(std::move(context), std::move(tag), representation.encoding)
+           : sendJson<T>(std::move(context), std::move(tag), representation.encoding);
+  }
+
+  template <typename T>
+  server::Handler getValues(Context && context) noexcept {
+    try {
+      if (!storage.authorized(context.user)) return forbidden(std::move(context));
+
+      // Read before the data so that the tag is never newer than the body. Unchanged data
+      // is answered before pinning, so that polling an evicted user does not load it
+      const auto representation = negotiate(context);
+      auto tag = entityTag<T>(context.user, representation);
+      if (notModified(context, tag)) return sendNotModified(std::move(context), std::move(tag));
+
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
+
+      // Polling clients mostly hit the cache, which costs a reference count bump
+      if (!dispatcher
+          || (!representation.packed && storage.serialized<T>(context.user))
+          || storage.jsonSize<T>(context.user) < constant::server::MAX_BUFFER) {
+        return sendValues<T>(std::move(context), std::move(tag), representation);
+      }
+
+      // Serializing large exports is deferred so that it cannot hold up small requests
+      const auto deferred = dispatcher->defer([context, tag = std::move(tag), representation]() mutable {
+        const auto pin = storage.pin(context.user);
+        if (!pin) return serviceUnavailable(std::move(context));
+        return sendValues<T>(std::move(context), std::move(tag), representation);
+      });
+      return deferred
+             ? restinio::request_accepted()
+             : serviceUnavailable(std::move(context));
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  // Cursors are handed out as millis:id
+  std::optional<Storage::Cursor> parseCursor(std::string_view cursor) {
+    const auto separator = cursor.find(':');
+    if (separator == std::string_view::npos) return {};
+
+    Storage::Cursor parsed{};
+    const auto millis = cursor.substr(0, separator);
+    const auto id = cursor.substr(separator + 1);
+    if (std::from_chars(millis.data(), millis.data() + millis.size(), parsed.millis).ptr != millis.data() + millis.size()
+        || std::from_chars(id.data(), id.data() + id.size(), parsed.id).ptr != id.data() + id.size()) {
+      return {};
+    }
+    return parsed;
+  }
+
+  template <typename Query>
+  std::optional<Storage::Range> parseRange(const Query & query) {
+    Storage::Range range;
+    if (query.has(constant::query::FROM)) range.from = restinio::cast_to<long>(query[constant::query::FROM]);
+    if (query.has(constant::query::TO)) range.to = restinio::cast_to<long>(query[constant::query::TO]);
+    if (query.has(constant::query::SKULL)) range.skull = restinio::cast_to<std::uint32_t>(query[constant::query::SKULL]);
+    if (query.has(constant::query::LIMIT)) {
+      range.limit = restinio::cast_to<std::size_t>(query[constant::query::LIMIT]);
+      if (range.limit == 0) return {};
+    }
+    if (query.has(constant::query::CURSOR)) {
+      range.after = parseCursor(query[constant::query::CURSOR]);
+      if (!range.after) return {};
+    }
+    return range;
+  }
+
+  // A window of a timed type, in chronological order. Whether more values follow is told by
+  // the next cursor header, absent on the last page
   template <typename T>
-  server::Handler getOrStream(Context && context) noexcept {
+  server::Handler getPage(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
 
-      if (storage.estimateSize<T>(context.user) < constant::server::MAX_BUFFER) {
-        return context.createResponse(restinio::status_ok())
-            .appendHeader(restinio::http_field::content_type, "text/json; charset=utf-8")
-            .setBody(storage.get<T>(context.user))
-            .done();
+      const auto query = restinio::parse_query(context.request->header().query());
+      const auto range = parseRange(query);
+      if (!range) return badRequest(std::move(context));
+
+      const auto representation = negotiate(context);
+      auto tag = entityTag<T>(context.user, representation);
+      if (notModified(context, tag)) return sendNotModified(std::move(context), std::move(tag));
+
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
+
+      auto page = storage.page<T>(context.user, *range, representation.packed);
+      auto response = okResponse(context, std::move(tag), representation.packed);
+      if (page.next) {
+        response.appendHeader(constant::header::X_NEXT_CURSOR, fmt::format("{:d}:{:d}", page.next->millis, page.next->id));
       }
+      return sendBody(std::move(response), std::move(page.body), representation.encoding);
+    } catch (const std::logic_error & e) {
+      return badRequest(std::move(context));
+    } catch (const restinio::exception_t & e) {
+      return badRequest(std::move(context));
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  // Occurrences downsampled into buckets. Only depends on the occurrences, so it is tagged
+  // by their version like the pages are. Series are not paged, so limit and cursor are
+  // rejected rather than ignored
+  server::Handler getSeries(Context && context) noexcept {
+    try {
+      if (!storage.authorized(context.user)) return forbidden(std::move(context));
 
-      auto response = context.createResponse<restinio::chunked_output_t>(restinio::status_ok())
-          .appendHeader(restinio::http_field::content_type, "text/json; charset=utf-8");
+      const auto query = restinio::parse_query(context.request->header().query());
+      const auto range = parseRange(query);
+      if (!range || range->after || query.has(constant::query::LIMIT)) return badRequest(std::move(context));
+      const auto granularity = Rollup::parse(query[constant::query::BY]);
+      if (!granularity) return badRequest(std::move(context));
+
+      const Representation representation{false, negotiate(context).encoding};
+      auto tag = entityTag<Occurrence>(context.user, representation);
+      if (notModified(context, tag)) return sendNotModified(std::move(context), std::move(tag));
+
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
-      storage.stream<T>(context.user, response);
-      return response.done();
+      return sendBody(okResponse(context, std::move(tag), false),
+                      storage.series(context.user, *range, *granularity),
+                      representation.encoding);
+    } catch (const std::logic_error & e) {
+      return badRequest(std::move(context));
+    } catch (const restinio::exception_t & e) {
+      return badRequest(std::move(context));
     } catch (const std::exception & e) {
       spdlog::error("{} Exception: {:s}", context, e.what());
       return internalServerError(std::move(context));
@@ -67,24 +334,71 @@ namespace {
 }
 
 namespace server {
-  void listen(std::string && host, std::uint16_t port, std::uint16_t threadCount) noexcept {
+  void listen(std::string && host,
+              std::uint16_t port,
+              std::uint16_t threadCount,
+              bool backgroundLoad,
+              std::size_t memoryBudget,
+              std::uint8_t durability,
+              std::chrono::milliseconds flushLatency,
+              bool userStrands,
+              std::uint8_t compressionLevel,
+              std::size_t compressionMinimum) noexcept {
+    if (durability > static_cast<std::uint8_t>(Durability::EveryWrite)) {
+      spdlog::warn("Unknown durability policy {:d}, syncing on every write", durability);
+      durability = static_cast<std::uint8_t>(Durability::EveryWrite);
+    }
+
+    if (compressionLevel > compression::MAX_LEVEL) {
+      spdlog::warn("Unknown compression level {:d}, using {:d}", compressionLevel, compression::MAX_LEVEL);
+      compressionLevel = compression::MAX_LEVEL;
+    }
+    compressionSettings.level = compressionLevel;
+    compressionSettings.minimum = compressionMinimum;
+    if (compressionLevel > 0) {
+      spdlog::info("Compressing responses from {:d} bytes at level {:d}", compressionMinimum, compressionLevel);
+    }
+
+    storage.start(memoryBudget, static_cast<Durability>(durability), flushLatency);
+
+    if (memoryBudget > 0) {
+      spdlog::info("Accepting requests while users are loaded on demand");
+    } else if (backgroundLoad) {
+      spdlog::info("Accepting requests while users are loaded in the background");
+    } else {
+      storage.wait();
+    }
+
+    const std::size_t workerCount = std::max<std::uint16_t>(threadCount, 1);
+    const std::size_t deferredCount = std::max(workerCount / 2, std::size_t{1});
+    if (userStrands) {
+      spdlog::info("Serializing requests per user on {:d} workers", workerCount);
+    } else {
+      spdlog::info("Handling requests on {:d} workers", workerCount);
+    }
+    dispatcher = std::make_unique<Dispatcher>(workerCount, deferredCount, userStrands);
+
     auto router = std::make_unique<restinio::router::express_router_t<>>();
 
-    router->http_get(constant::path::SKULL, [](auto request, auto) { return getSkull(request); });
-    router->http_post(constant::path::SKULL, [](auto request, auto) { return postSkull(request); });
-    router->http_delete(constant::path::SKULL, [](auto request, auto) { return deleteSkull(request); });
-    router->http_get(constant::path::QUICK, [](auto request, auto) { return getQuick(request); });
-    router->http_post(constant::path::QUICK, [](auto request, auto) { return postQuick(request); });
-    router->http_delete(constant::path::QUICK, [](auto request, auto) { return deleteQuick(request); });
-    router->http_get(constant::path::OCCURRENCE, [](auto request, auto) { return getOccurrence(request); });
-    router->http_post(constant::path::OCCURRENCE, [](auto request, auto) { return postOccurrence(request); });
-    router->http_delete(constant::path::OCCURRENCE, [](auto request, auto) { return deleteOccurrence(request); });
-    router->http_get(constant::path::RELOAD, [](auto request, auto) { return reload(request); });
+    router->http_get(constant::path::SKULL, [](auto request, auto) { return dispatch(request, getSkull); });
+    router->http_post(constant::path::SKULL, [](auto request, auto) { return dispatch(request, postSkull); });
+    router->http_delete(constant::path::SKULL, [](auto request, auto) { return dispatch(request, deleteSkull); });
+    router->http_get(constant::path::QUICK, [](auto request, auto) { return dispatch(request, getQuick); });
+    router->http_post(constant::path::QUICK, [](auto request, auto) { return dispatch(request, postQuick); });
+    router->http_delete(constant::path::QUICK, [](auto request, auto) { return dispatch(request, deleteQuick); });
+    router->http_get(constant::path::OCCURRENCE, [](auto request, auto) { return dispatch(request, getOccurrence); });
+    router->http_post(constant::path::OCCURRENCE, [](auto request, auto) { return dispatch(request, postOccurrence); });
+    router->http_delete(constant::path::OCCURRENCE, [](auto request, auto) { return dispatch(request, deleteOccurrence); });
+    router->http_get(constant::path::RELOAD, [](auto request, auto) { return dispatch(request, reload); });
+    router->http_get(constant::path::SYNC, [](auto request, auto) { return dispatch(request, getSync); });
+    router->http_get(constant::path::ROLLUP, [](auto request, auto) { return dispatch(request, getRollup); });
     router->non_matched_request_handler([](auto request) { return notFound(request); });
 #ifdef LOCAL_DEVELOPMENT
     router->add_handler(restinio::http_method_options(), constant::path::SKULL, [](auto request, auto) { return emptyOk(request); });
     router->add_handler(restinio::http_method_options(), constant::path::QUICK, [](auto request, auto) { return emptyOk(request); });
     router->add_handler(restinio::http_method_options(), constant::path::OCCURRENCE, [](auto request, auto) { return emptyOk(request); });
+    router->add_handler(restinio::http_method_options(), constant::path::SYNC, [](auto request, auto) { return emptyOk(request); });
+    router->add_handler(restinio::http_method_options(), constant::path::ROLLUP, [](auto request, auto) { return emptyOk(request); });
 #endif
 
     if (threadCount < 2) {
@@ -92,6 +406,7 @@ namespace server {
 
       restinio::run(restinio::on_this_thread<ServerTraits>()
                         .address(std::move(host))
+                        .write_http_response_timelimit(constant::server::WRITE_TIMEOUT)
                         .port(port)
                         .request_handler(std::move(router)));
     } else {
@@ -99,18 +414,21 @@ namespace server {
 
       restinio::run(restinio::on_thread_pool<ServerTraits>(threadCount)
                         .address(std::move(host))
+                        .write_http_response_timelimit(constant::server::WRITE_TIMEOUT)
                         .port(port)
                         .request_handler(std::move(router)));
     }
   }
 
   Handler getSkull(Context && context) noexcept {
-    return getOrStream<Skull>(std::move(context));
+    return getValues<Skull>(std::move(context));
   }
 
   Handler postSkull(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
       const auto query = restinio::parse_query(context.request->header().query());
       if (!query.has(constant::query::NAME)
@@ -119,23 +437,24 @@ namespace server {
         return badRequest(std::move(context));
       }
 
-      Skull value{storage.nextId<Skull>(context.user),
-                  query[constant::query::NAME],
-                  query[constant::query::COLOR],
-                  query[constant::query::ICON],
-                  restinio::value_or(query, constant::query::UNIT_PRICE, 0.0f),
-                  restinio::opt_value<float>(query, constant::query::LIMIT)};
+      const auto name = query[constant::query::NAME];
+      const auto color = query[constant::query::COLOR];
+      const auto icon = query[constant::query::ICON];
+      const auto unitPrice = restinio::value_or(query, constant::query::UNIT_PRICE, 0.0f);
+      const auto limit = restinio::opt_value<float>(query, constant::query::LIMIT);
 
-    if (value.name().empty() || value.color().empty() || value.icon().empty()) {
+      if (name.empty() || color.empty() || icon.empty()) {
         return badRequest(std::move(context));
       }
 
-      if (value.name() == constant::query::UNDEFINED
-          || value.color() == constant::query::UNDEFINED
-          || value.icon() == constant::query::UNDEFINED) {
+      if (name == constant::query::UNDEFINED
+          || color == constant::query::UNDEFINED
+          || icon == constant::query::UNDEFINED) {
         return badRequest(std::move(context));
       }
 
+      // Ids are only taken once the request is known to be valid, so that rejected ones leave no gaps
+      Skull value{storage.nextId<Skull>(context.user), name, color, icon, unitPrice, limit};
       return storage.add(context.user, std::move(value))
              ? context.createResponse(restinio::status_created()).done()
              : context.createResponse(restinio::status_internal_server_error()).done();
@@ -152,10 +471,12 @@ namespace server {
   Handler deleteSkull(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
       const auto query = restinio::parse_query(context.request->header().query());
 
-      Skull value{restinio::value_or<unsigned short>(query, constant::query::ID, 0),
+      Skull value{restinio::value_or<std::uint32_t>(query, constant::query::ID, 0),
                   "",
                   "",
                   "",
@@ -180,19 +501,21 @@ namespace server {
   }
 
   Handler getQuick(Context && context) noexcept {
-    return getOrStream<Quick>(std::move(context));
+    return getValues<Quick>(std::move(context));
   }
 
   Handler postQuick(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
       const auto query = restinio::parse_query(context.request->header().query());
       if (!query.has(constant::query::SKULL) || !query.has(constant::query::AMOUNT)) {
         return badRequest(std::move(context));
       }
 
-      Quick value{restinio::cast_to<unsigned short>(query[constant::query::SKULL]),
+      Quick value{restinio::cast_to<std::uint32_t>(query[constant::query::SKULL]),
                   restinio::cast_to<float>(query[constant::query::AMOUNT])};
 
       if (value.skull() == 0 || value.amount() <= 0.0f)  {
@@ -215,6 +538,8 @@ namespace server {
   Handler deleteQuick(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
       const auto query = restinio::parse_query(context.request->header().query());
       if (!query.has(constant::query::SKULL)
@@ -222,7 +547,7 @@ namespace server {
         return badRequest(std::move(context));
       }
 
-      Quick value{restinio::cast_to<unsigned short>(query[constant::query::SKULL]),
+      Quick value{restinio::cast_to<std::uint32_t>(query[constant::query::SKULL]),
                   restinio::cast_to<float>(query[constant::query::AMOUNT])};
 
       if (value.skull() == 0 || value.amount() <= 0.0f)  {
@@ -243,29 +568,49 @@ namespace server {
   }
 
   Handler getOccurrence(Context && context) noexcept {
-    return getOrStream<Occurrence>(std::move(context));
+    try {
+      const auto query = restinio::parse_query(context.request->header().query());
+      if (query.has(constant::query::BY)) return getSeries(std::move(context));
+
+      // Other parameters, such as cache busters, still get the cached representation
+      for (const auto parameter : {constant::query::FROM,
+                                   constant::query::TO,
+                                   constant::query::SKULL,
+                                   constant::query::LIMIT,
+                                   constant::query::CURSOR}) {
+        if (query.has(parameter)) return getPage<Occurrence>(std::move(context));
+      }
+    } catch (const restinio::exception_t & e) {
+      return badRequest(std::move(context));
+    }
+    return getValues<Occurrence>(std::move(context));
   }
 
   Handler postOccurrence(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
       const auto query = restinio::parse_query(context.request->header().query());
       if (!query.has(constant::query::SKULL) || !query.has(constant::query::AMOUNT)) {
         return badRequest(std::move(context));
       }
 
-      Occurrence value{storage.nextId<Occurrence>(context.user),
-                  restinio::cast_to<unsigned short>(query[constant::query::SKULL]),
-                  restinio::cast_to<float>(query[constant::query::AMOUNT]),
-                  std::chrono::duration_cast<std::chrono::milliseconds>(
-                      std::chrono::system_clock::now().time_since_epoch()
-                  ).count()};
+      const auto skull = restinio::cast_to<std::uint32_t>(query[constant::query::SKULL]);
+      const auto amount = restinio::cast_to<float>(query[constant::query::AMOUNT]);
 
-      if (value.skull() == 0 || value.amount() <= 0.0f)  {
+      if (skull == 0 || amount <= 0.0f)  {
         return badRequest(std::move(context));
       }
 
+      // As for skulls, the id is only taken once nothing can reject the request anymore
+      Occurrence value{storage.nextId<Occurrence>(context.user),
+                       skull,
+                       amount,
+                       std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()
+                       ).count()};
       return storage.add(context.user, std::move(value))
              ? context.createResponse(restinio::status_created()).done()
              : context.createResponse(restinio::status_internal_server_error()).done();
@@ -282,13 +627,15 @@ namespace server {
   Handler deleteOccurrence(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
       const auto query = restinio::parse_query(context.request->header().query());
       if (!query.has(constant::query::ID)) {
         return badRequest(std::move(context));
       }
 
-      Occurrence value{restinio::cast_to<unsigned short>(query[constant::query::ID]), 0, 0, 0};
+      Occurrence value{restinio::cast_to<std::uint32_t>(query[constant::query::ID]), 0, 0, 0};
 
       if (value.id() == 0) {
         return badRequest(std::move(context));
@@ -307,13 +654,83 @@ namespace server {
     }
   }
 
+  Handler getSync(Context && context) noexcept {
+    try {
+      if (!storage.authorized(context.user)) return forbidden(std::move(context));
+
+      // The feed lives outside of the data, so there is no need to pin
+      const auto query = restinio::parse_query(context.request->header().query());
+      const auto since = restinio::opt_value<std::uint64_t>(query, constant::query::SINCE);
+
+      auto response = context.createResponse(restinio::status_ok())
+          .appendHeader(restinio::http_field::content_type, "text/json; charset=utf-8")
+          .appendHeader(restinio::http_field::vary, "accept-encoding")
+          .appendHeader(restinio::http_field::cache_control, "no-store");
+      return sendBody(std::move(response), storage.changes(context.user, since), negotiate(context).encoding);
+    } catch (const std::logic_error & e) {
+      return badRequest(std::move(context));
+    } catch (const restinio::exception_t & e) {
+      return badRequest(std::move(context));
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
+  Handler getRollup(Context && context) noexcept {
+    try {
+      if (!storage.authorized(context.user)) return forbidden(std::move(context));
+
+      const auto query = restinio::parse_query(context.request->header().query());
+      const auto granularity = Rollup::parse(query.has(constant::query::BY) ? query[constant::query::BY] : "day");
+      if (!granularity) return badRequest(std::move(context));
+
+      const auto from = query.has(constant::query::FROM)
+                        ? restinio::cast_to<long>(query[constant::query::FROM])
+                        : std::numeric_limits<long>::min();
+      const auto to = query.has(constant::query::TO)
+                      ? restinio::cast_to<long>(query[constant::query::TO])
+                      : std::numeric_limits<long>::max();
+      const auto skull = restinio::opt_value<std::uint32_t>(query, constant::query::SKULL);
+
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
+
+      // Values follow the current unit prices, so there is no single version to tag
+      auto response = context.createResponse(restinio::status_ok())
+          .appendHeader(restinio::http_field::content_type, "text/json; charset=utf-8")
+          .appendHeader(restinio::http_field::vary, "accept-encoding")
+          .appendHeader(restinio::http_field::cache_control, "no-cache");
+      return sendBody(std::move(response),
+                      storage.rollup(context.user, *granularity, from, to, skull),
+                      negotiate(context).encoding);
+    } catch (const std::logic_error & e) {
+      return badRequest(std::move(context));
+    } catch (const restinio::exception_t & e) {
+      return badRequest(std::move(context));
+    } catch (const std::exception & e) {
+      spdlog::error("{} Exception: {:s}", context, e.what());
+      return internalServerError(std::move(context));
+    }
+  }
+
   Handler reload(Context && context) noexcept {
     try {
       if (!storage.authorized(context.user)) return forbidden(std::move(context));
+      const auto pin = storage.pin(context.user);
+      if (!pin) return serviceUnavailable(std::move(context));
 
-      return storage.reload(context.user)
-             ? context.createResponse(restinio::status_accepted()).done()
-             : context.createResponse(restinio::status_internal_server_error()).done();
+      if (!dispatcher) {
+        return storage.reload(context.user)
+               ? context.createResponse(restinio::status_ok()).done()
+               : context.createResponse(restinio::status_internal_server_error()).done();
+      }
+
+      // Readers keep the previous data until the reload swaps it in
+      if (!dispatcher->defer([name = std::string{context.user.name}] { storage.reload(User{name}); })) {
+        return serviceUnavailable(std::move(context));
+      }
+      return context.createResponse(restinio::status_accepted()).done();
     } catch (const std::exception & e) {
       spdlog::error("{} Exception: {:s}", context, e.what());
       return internalServerError(std::move(context));
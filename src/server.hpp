@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 #include <restinio/all.hpp>
 
 #include "context.hpp"
@@ -7,7 +9,16 @@
 namespace server {
   using Handler = restinio::request_handling_status_t;
 
-  void listen(std::string && host, std::uint16_t port, std::uint16_t threadCount) noexcept;
+  void listen(std::string && host,
+              std::uint16_t port,
+              std::uint16_t threadCount,
+              bool backgroundLoad,
+              std::size_t memoryBudget,
+              std::uint8_t durability,
+              std::chrono::milliseconds flushLatency,
+              bool userStrands,
+              std::uint8_t compressionLevel,
+              std::size_t compressionMinimum) noexcept;
 
   Handler getSkull(Context &&) noexcept;
   Handler postSkull(Context &&) noexcept;
@@ -18,5 +29,7 @@ namespace server {
   Handler getOccurrence(Context &&) noexcept;
   Handler postOccurrence(Context &&) noexcept;
   Handler deleteOccurrence(Context &&) noexcept;
+  Handler getSync(Context &&) noexcept;
+  Handler getRollup(Context &&) noexcept;
   Handler reload(Context &&) noexcept;
 }
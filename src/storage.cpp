@@ -1,78 +1,720 @@
 #include "storage.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <limits>
 
 #include <spdlog/spdlog.h>
 
+#include "parser.hpp"
+
 namespace {
   template <typename T>
-  std::optional<T> parseValue(std::string_view view) {
-    std::array<std::string_view, T::size> segments;
+  void loadValues(const std::string & directory, const char * const fileName, std::vector<T> & vector) {
+    MappedFile mapped(directory, fileName);
+    if (!mapped.good()) return;
+
+    parser::forEachLine(mapped.view(), [&](std::string_view line, std::size_t number) {
+      std::size_t column{0};
+      auto entry = parser::parse<T>(line, column);
+      if (!entry) {
+        spdlog::error("Malformed value entry at {:s}:{:d}:{:d}: {:s}", mapped.path, number, column, line);
+        return;
+      }
 
-    std::size_t index{0};
-    for (auto i = 0; i < T::size - 1; ++i) {
-      auto next = view.find('\t', index);
-      if (next == std::string_view::npos) return {};
+      vector.emplace_back(std::move(*entry));
+    });
+  }
 
-      segments[i] = view.substr(index, next - index);
-      index = next + 1;
+  template <typename R, typename T>
+  void decodeRecords(const MappedFile & mapped, std::vector<T> & vector) {
+    const auto size = mapped.size - sizeof(format::binaryHeader);
+    const auto count = size / sizeof(R);
+    if (size % sizeof(R) != 0) {
+      spdlog::error("Trailing bytes in snapshot {:s}", mapped.path);
     }
 
-    if (view.find('\t', index) != std::string_view::npos) return {};
+    vector.reserve(vector.size() + count);
+    auto cursor = mapped.data + sizeof(format::binaryHeader);
+    for (std::size_t i = 0; i < count; ++i, cursor += sizeof(R)) {
+      R record;
+      std::memcpy(&record, cursor, sizeof(R));
+      vector.emplace_back(record);
+    }
+  }
 
-    segments[T::size - 1] = view.substr(index);
+  // Snapshots in the legacy layout are converted and flagged as outdated
+  template <typename T>
+  bool loadRecords(const std::string & directory,
+                   const char * const fileName,
+                   std::vector<T> & vector,
+                   std::uint32_t & sequence,
+                   bool & outdated) {
+    MappedFile mapped(directory, fileName);
+    if (!mapped.good()) return false;
 
-    try {
-      return std::make_optional(segments);
-    } catch(const std::exception &) {
-      return {};
+    format::binaryHeader header{};
+    if (mapped.size < sizeof(header)) {
+      spdlog::error("Truncated snapshot {:s}", mapped.path);
+      return false;
     }
+
+    std::memcpy(&header, mapped.data, sizeof(header));
+    if (header.matches<T>()) {
+      decodeRecords<typename T::Record>(mapped, vector);
+      sequence = std::max(sequence, header.sequence);
+    } else if (header.matches<typename T::LegacyRecord>(T::legacyVersion)) {
+      spdlog::info("Migrating {:s} from version {:d}", mapped.path, header.version);
+      decodeRecords<typename T::LegacyRecord>(mapped, vector);
+      outdated = true;
+    } else {
+      spdlog::error("Unsupported snapshot version {:d} in {:s}", header.version, mapped.path);
+      return false;
+    }
+
+    return true;
   }
 }
 
-Storage::Storage() {
-  UserIterator::forEach([this](const User & user) {
-    auto skull = mSkulls.try_emplace(user, std::vector<Skull>{});
-    auto quick = mQuicks.try_emplace(user, std::vector<Quick>{});
-    auto occurrence = mOccurrences.try_emplace(user, std::vector<Occurrence>{});
+Storage::Storage(std::string root) : mRoot{std::move(root)} {
+  // Sequences handed out by a previous run stay below this, unless it made more changes
+  // than the microseconds it ran for
+  const std::uint64_t start = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()
+  ).count();
 
-    if (skull.second) {
-      load(user, skull.first->second.vector);
-    } else {
-      spdlog::warn("Failed to populate skull map for {:s}", user.name);
+  UserIterator::forEach(mRoot, [this, start](const User & user) {
+    // The map keys point into these names, so they must outlive the maps
+    const User key{mUserNames.emplace_back(user.name)};
+
+    auto skull = mSkulls.try_emplace(key);
+    auto quick = mQuicks.try_emplace(key);
+    auto occurrence = mOccurrences.try_emplace(key);
+
+    if (!skull.second || !quick.second || !occurrence.second) {
+      spdlog::warn("Failed to populate maps for {:s}", user.name);
+      mUserNames.pop_back();
+      return;
     }
 
-    if (quick.second) {
-      load(user, quick.first->second.vector);
-    } else {
-      spdlog::warn("Failed to populate quick map for {:s}", user.name);
+    mResidency.try_emplace(key);
+    mFeeds.try_emplace(key, start);
+
+    // Snapshots a crash interrupted are never committed, nothing else writes them
+    SnapshotHandle::discard(directoryOf(user.name), ".");
+    SnapshotHandle::discard(directoryOf(user.name), TypeProps<Occurrence>::segments);
+  });
+}
+
+void Storage::start(std::size_t memoryBudget, Durability durability, std::chrono::milliseconds flushLatency) {
+  mMemoryBudget = memoryBudget;
+  mDurability = durability;
+  mFlushLatency = flushLatency;
+
+  if (mMemoryBudget == 0) {
+    mLoader = std::thread{&Storage::populate, this};
+  } else {
+    spdlog::info("Loading users on demand within {:d} bytes", mMemoryBudget);
+  }
+
+  mWriter = std::thread{&Storage::persist, this};
+}
+
+std::size_t Storage::footprint(const User & user) {
+  return footprint(mSkulls.find(user)->second)
+         + footprint(mQuicks.find(user)->second)
+         + footprint(mOccurrences.find(user)->second);
+}
+
+void Storage::populate() {
+  const auto start = std::chrono::steady_clock::now();
+  const auto elapsed = [](std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+  };
+
+  // Each task loads a single type for a single user
+  const auto taskCount = mUserNames.size() * TYPE_COUNT;
+  std::atomic<std::size_t> next{0};
+
+  const auto worker = [&] {
+    for (auto task = next++; task < taskCount; task = next++) {
+      const User user{mUserNames[task / TYPE_COUNT]};
+      const auto taskStart = std::chrono::steady_clock::now();
+
+      switch (task % TYPE_COUNT) {
+        case 0:
+          load(user, mSkulls.find(user)->second);
+          spdlog::debug("Loaded skull for {:s} in {:d}ms", user.name, elapsed(taskStart));
+          break;
+        case 1:
+          load(user, mQuicks.find(user)->second);
+          spdlog::debug("Loaded quick for {:s} in {:d}ms", user.name, elapsed(taskStart));
+          break;
+        default:
+          load(user, mOccurrences.find(user)->second);
+          spdlog::debug("Loaded occurrence for {:s} in {:d}ms", user.name, elapsed(taskStart));
+          break;
+      }
+
+      auto & residency = mResidency.find(user)->second;
+      if (--residency.loading == 0) {
+        residency.bytes = footprint(user);
+        mResidentBytes += residency.bytes;
+        residency.resident = true;
+        spdlog::info("User {:s} ready after {:d}ms", user.name, elapsed(start));
+      }
     }
+  };
+
+  const auto threadCount = std::max<std::size_t>(1, std::min<std::size_t>(std::thread::hardware_concurrency(), taskCount));
+  std::vector<std::thread> workers;
+  workers.reserve(threadCount - 1);
+  for (std::size_t i = 1; i < threadCount; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+
+  for (auto & thread : workers) {
+    thread.join();
+  }
+
+  spdlog::info("Loaded {:d} users on {:d} threads in {:d}ms", mUserNames.size(), threadCount, elapsed(start));
+}
+
+void Storage::wait() {
+  if (mLoader.joinable()) mLoader.join();
+}
+
+Storage::Pin Storage::pin(const User & user) {
+  const auto found = mResidency.find(user);
+  if (found == mResidency.end()) return {};
+
+  auto & residency = found->second;
+  if (mMemoryBudget == 0) {
+    return residency.resident ? Pin{this, nullptr, nullptr} : Pin{};
+  }
+
+  {
+    std::lock_guard lock{residency.mutex};
+    ++residency.pins;
+    residency.lastUse = ++mClock;
 
-    if (occurrence.second) {
-      load(user, occurrence.first->second.vector);
+    if (residency.resident) {
+      ++mHits;
     } else {
-      spdlog::warn("Failed to populate occurrence map for {:s}", user.name);
+      ++mMisses;
+      const auto start = std::chrono::steady_clock::now();
+
+      {
+        auto & skull = mSkulls.find(user)->second;
+        std::lock_guard skullLock{skull.mutex};
+        load(user, skull);
+      }
+      {
+        auto & quick = mQuicks.find(user)->second;
+        std::lock_guard quickLock{quick.mutex};
+        load(user, quick);
+      }
+      {
+        auto & occurrence = mOccurrences.find(user)->second;
+        std::lock_guard occurrenceLock{occurrence.mutex};
+        load(user, occurrence);
+      }
+
+      residency.bytes = footprint(user);
+      mResidentBytes += residency.bytes;
+      residency.resident = true;
+
+      spdlog::info("User {:s} loaded on demand in {:d}ms",
+                   user.name,
+                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
     }
+  }
+
+  return Pin{this, &found->first, &residency};
+}
+
+Storage::Pin::~Pin() {
+  if (residency == nullptr) return;
+
+  {
+    std::lock_guard lock{residency->mutex};
+    --residency->pins;
+
+    // Mutations and cached responses change the size, so it is measured after every use
+    if (residency->resident) {
+      const auto bytes = storage->footprint(*user);
+      storage->mResidentBytes += bytes - residency->bytes;
+      residency->bytes = bytes;
+    }
+  }
+
+  if (storage->mResidentBytes > storage->mMemoryBudget) {
+    storage->evict();
+  }
+}
+
+void Storage::drain() {
+  // Flushing is left to the writer so that mDurable, and whoever waits on it, keeps
+  // following every batch
+  std::unique_lock lock{mPendingMutex};
+  const auto sequence = mEnqueued;
+  if (mDurable >= sequence) return;
+
+  ++mDraining;
+  mPendingCondition.notify_one();
+  mDurableCondition.wait(lock, [this, sequence] { return mStopping || mDurable >= sequence; });
+  --mDraining;
+}
+
+void Storage::evict() {
+  std::unique_lock evictionLock{mEvictionMutex, std::try_to_lock};
+  if (!evictionLock.owns_lock()) return;
+
+  while (mResidentBytes > mMemoryBudget) {
+    const User * candidate{nullptr};
+    std::uint64_t oldest{std::numeric_limits<std::uint64_t>::max()};
+    for (const auto & [user, residency] : mResidency) {
+      if (residency.resident && residency.pins == 0 && residency.lastUse < oldest) {
+        candidate = &user;
+        oldest = residency.lastUse;
+      }
+    }
+
+    if (candidate == nullptr) return;
 
+    auto & residency = mResidency.find(*candidate)->second;
+    std::lock_guard lock{residency.mutex};
+    if (!residency.resident || residency.pins > 0) continue;
+
+    // Unpinned users cannot be mutated, so nothing new is queued after the drain
+    drain();
+    unload(mSkulls.find(*candidate)->second);
+    unload(mQuicks.find(*candidate)->second);
+    unload(mOccurrences.find(*candidate)->second);
+
+    residency.resident = false;
+    mResidentBytes -= residency.bytes;
+    residency.bytes = 0;
+    ++mEvictions;
+
+    spdlog::info("Evicted {:s}", candidate->name);
+    logStats();
+  }
+}
+
+bool Storage::reload(const User & user) {
+  if (mResidency.find(user) == mResidency.cend()) return false;
+
+  const auto pin = this->pin(user);
+  if (!pin) return false;
+
+  auto refreshed = refresh(user, mSkulls.find(user)->second);
+  refreshed = refresh(user, mQuicks.find(user)->second) && refreshed;
+  refreshed = refresh(user, mOccurrences.find(user)->second) && refreshed;
+
+  // Whatever changed on disk is not in the feed, so every client has to fetch again
+  auto & feed = mFeeds.find(user)->second;
+  {
+    std::lock_guard lock{feed.mutex};
+    feed.changes.clear();
+    feed.horizon = ++feed.sequence;
+  }
+
+  if (!refreshed) return false;
+
+  spdlog::info("Reloaded {:s}", user.name);
+  return true;
+}
+
+std::string Storage::series(const User & user, Range range, Granularity granularity) {
+  const auto values = snapshot<Occurrence>(user);
+  if (!values) return "[]";
+
+  // Values come in chronological order, so each bucket is complete once the next starts
+  std::vector<std::pair<std::int64_t, Rollup::Total>> buckets;
+  range.limit = std::numeric_limits<std::size_t>::max();
+  range.after.reset();
+  forRange<Occurrence>(*values, range, [&buckets, granularity](const Occurrence & value) {
+    const auto bucket = Rollup::bucketOf(value.millis(), granularity);
+    if (buckets.empty() || buckets.back().first != bucket) buckets.emplace_back(bucket, Rollup::Total{});
+    buckets.back().second.amount += value.amount();
+    ++buckets.back().second.count;
   });
+
+  format::writer output;
+  output.reserve(2 + buckets.size() * 64);
+  output << '[';
+  for (std::size_t i = 0; i < buckets.size(); ++i) {
+    const auto & [bucket, total] = buckets[i];
+    if (i > 0) output << ',';
+    output << R"({"start":)" << Rollup::startOf(bucket, granularity)
+           << R"(,"amount":)" << total.amount
+           << R"(,"count":)" << total.count
+           << '}';
+  }
+  output << ']';
+  return output.release();
+}
+
+std::string Storage::rollup(const User & user,
+                            Granularity granularity,
+                            long from,
+                            long to,
+                            std::optional<std::uint32_t> skull) {
+  const auto occurrences = mOccurrences.find(user);
+  if (occurrences == mOccurrences.end()) return "[]";
+
+  // Prices are applied on the way out, since a skull's unit price is the same for all of
+  // its occurrences. The lock is only held to copy the totals
+  struct Row {
+    std::int64_t bucket;
+    std::uint32_t skull;
+    Rollup::Total total;
+  };
+  std::vector<Row> rows;
+  {
+    std::lock_guard lock{occurrences->second.mutex};
+    occurrences->second.rollup.forEach(granularity, from, to, skull, [&rows](auto bucket, auto id, const auto & total) {
+      rows.push_back({bucket, id, total});
+    });
+  }
+
+  std::unordered_map<std::uint32_t, float> prices;
+  if (const auto skulls = snapshot<Skull>(user)) {
+    skulls->forEach([&prices](const Skull & value) { prices.emplace(value.id(), value.unitPrice()); });
+  }
+
+  format::writer output;
+  output.reserve(2 + rows.size() * 96);
+  output << '[';
+  for (std::size_t i = 0; i < rows.size(); ++i) {
+    const auto & row = rows[i];
+    const auto price = prices.find(row.skull);
+
+    if (i > 0) output << ',';
+    output << R"({"start":)" << Rollup::startOf(row.bucket, granularity)
+           << R"(,"skull":)" << row.skull
+           << R"(,"amount":)" << row.total.amount
+           << R"(,"count":)" << row.total.count
+           << R"(,"value":)" << (price == prices.cend() ? 0.0 : row.total.amount * price->second)
+           << '}';
+  }
+  output << ']';
+  return output.release();
+}
+
+std::string Storage::changes(const User & user, std::optional<std::uint64_t> since) {
+  const auto feed = mFeeds.find(user);
+  if (feed == mFeeds.end()) return R"({"sequence":0,"reset":true})";
+
+  std::lock_guard lock{feed->second.mutex};
+  format::writer output;
+  output << R"({"sequence":)" << feed->second.sequence;
+
+  if (!since || *since < feed->second.horizon || *since > feed->second.sequence) {
+    output << R"(,"reset":true})";
+    return output.release();
+  }
+
+  // Sequences are contiguous, so the first change to send is found by offset
+  const auto & changes = feed->second.changes;
+  const auto first = static_cast<std::size_t>(*since - feed->second.horizon);
+
+  output << R"(,"reset":false,"changes":[)";
+  for (auto change = changes.cbegin() + first; change != changes.cend(); ++change) {
+    if (change != changes.cbegin() + first) output << ',';
+    output << change->second;
+  }
+  output << "]}";
+  return output.release();
+}
+
+void Storage::logStats() const {
+  spdlog::info("Residency: {:d}/{:d} bytes, {:d} hits, {:d} misses, {:d} evictions",
+               mResidentBytes.load(),
+               mMemoryBudget,
+               mHits.load(),
+               mMisses.load(),
+               mEvictions.load());
+}
+
+Storage::~Storage() {
+  wait();
+
+  {
+    std::lock_guard lock{mPendingMutex};
+    mStopping = true;
+  }
+
+  mPendingCondition.notify_all();
+  mDrainedCondition.notify_all();
+  if (mWriter.joinable()) mWriter.join();
+}
+
+void Storage::persist() {
+  std::vector<std::string> unsynced;
+  auto lastSync = std::chrono::steady_clock::now();
+
+  const auto sync = [&unsynced, &lastSync] {
+    std::sort(unsynced.begin(), unsynced.end());
+    unsynced.erase(std::unique(unsynced.begin(), unsynced.end()), unsynced.end());
+    auto synced = true;
+    for (const auto & path : unsynced) {
+      synced = FileHandle<std::ofstream>::sync(path) && synced;
+    }
+    unsynced.clear();
+    lastSync = std::chrono::steady_clock::now();
+    return synced;
+  };
+
+  std::unique_lock lock{mPendingMutex};
+  while (true) {
+    const auto hasWork = [this] { return mStopping || mPendingCount > 0; };
+    if (unsynced.empty()) {
+      mPendingCondition.wait(lock, hasWork);
+    } else {
+      mPendingCondition.wait_until(lock, lastSync + constant::storage::SYNC_INTERVAL, hasWork);
+    }
+
+    // Give concurrent mutations a chance to be coalesced into the same flush. Writers
+    // waiting on durability are already batched by the time the previous sync takes
+    if (mPendingCount > 0 && mDurability != Durability::EveryWrite && mFlushLatency.count() > 0) {
+      mPendingCondition.wait_for(lock, mFlushLatency, [this] {
+        return mStopping || mDraining > 0 || mPendingCount >= constant::storage::MAX_PENDING;
+      });
+    }
+
+    auto pending = std::move(mPending);
+    mPending.clear();
+    mPendingCount = 0;
+    const auto sequence = mEnqueued;
+    const auto stopping = mStopping;
+
+    lock.unlock();
+    mDrainedCondition.notify_all();
+
+    auto durable = true;
+    for (const auto & [user, entries] : pending) {
+      durable = flush<Skull>(user, entries.skulls, unsynced) && durable;
+      durable = flush<Quick>(user, entries.quicks, unsynced) && durable;
+      durable = flush<Occurrence>(user, entries.occurrences, unsynced) && durable;
+    }
+
+    // A single sync per touched journal covers every mutation in the batch
+    switch (mDurability) {
+      case Durability::None:
+        unsynced.clear();
+        break;
+      case Durability::Interval:
+        if (stopping || std::chrono::steady_clock::now() - lastSync >= constant::storage::SYNC_INTERVAL) {
+          sync();
+        }
+        break;
+      case Durability::EveryWrite:
+        durable = sync() && durable;
+        break;
+    }
+
+    lock.lock();
+    if (!durable && mAwaiting > 0) mFailed.emplace_back(mDurable, sequence);
+    mDurable = sequence;
+    mDurableCondition.notify_all();
+
+    if (stopping && pending.empty()) return;
+  }
 }
 
 template <typename T>
-void Storage::load(const User & user, std::vector<T> & vector) {
-  FileHandle<std::ifstream> handle(user.name, TypeProps<T>::path);
-  if (!handle.good()) return;
+void Storage::load(const User & user, LockedVector<T> & values) {
+  if (read(user, values)) {
+    compact(directoryOf(user.name), values);
+  }
+}
 
-  std::string buffer;
-  vector.clear();
-  while (std::getline(handle.file, buffer)) {
-    if (buffer.empty()) continue;
+template <typename T>
+bool Storage::read(const User & user, LockedVector<T> & values) {
+  const auto directory = directoryOf(user.name);
+
+  // Readers may still hold the previous entries, so they are replaced rather than cleared
+  values.entries = std::make_shared<Entries<T>>();
+  auto & vector = values.entries->values;
+  values.journaled = 0;
+  values.dirty.clear();
+
+  auto migrate = false;
+  std::uint32_t sequence{0};
+  if constexpr (TypeProps<T>::segmented) {
+    if (FileHandle<std::ifstream>::exists(directory, TypeProps<T>::segments)) {
+      SegmentIterator::forEach(directory, TypeProps<T>::segments, [&](const std::string & segment) {
+        const auto month = segmentOf<T>(segment);
+        if (!month) {
+          spdlog::warn("Skipping {:s} for {:s}", segment, user.name);
+          return;
+        }
+
+        auto outdated = false;
+        loadRecords(directory, segment.c_str(), vector, sequence, outdated);
+
+        // Rewritten even when empty so that the legacy layout does not linger
+        if (outdated) {
+          values.dirty.insert(*month);
+          migrate = true;
+        }
+      });
+    } else if (FileHandle<std::ifstream>::exists(directory, TypeProps<T>::snapshot)) {
+      spdlog::info("Migrating {:s} for {:s} to segments", TypeProps<T>::snapshot, user.name);
+      if (!loadRecords(directory, TypeProps<T>::snapshot, vector, sequence, migrate)) return false;
+      migrate = true;
+    } else if (FileHandle<std::ifstream>::exists(directory, TypeProps<T>::path)) {
+      spdlog::info("Migrating {:s} for {:s} to segments", TypeProps<T>::path, user.name);
+      loadValues(directory, TypeProps<T>::path, vector);
+      migrate = true;
+    }
+  } else if constexpr (TypeProps<T>::binary) {
+    if (FileHandle<std::ifstream>::exists(directory, TypeProps<T>::snapshot)) {
+      if (!loadRecords(directory, TypeProps<T>::snapshot, vector, sequence, migrate)) return false;
+    } else if (FileHandle<std::ifstream>::exists(directory, TypeProps<T>::path)) {
+      spdlog::info("Migrating {:s} for {:s} to binary snapshot", TypeProps<T>::path, user.name);
+      loadValues(directory, TypeProps<T>::path, vector);
+      migrate = true;
+    }
+  } else {
+    loadValues(directory, TypeProps<T>::path, vector);
+
+    if constexpr (TypeProps<T>::identified) {
+      if (FileHandle<std::ifstream>::exists(directory, TypeProps<T>::sequence)) {
+        FileHandle<std::ifstream> handle(directory, TypeProps<T>::sequence);
+        handle.file >> sequence;
+      }
+    }
+  }
+
+  if (migrate) {
+    for (const auto & value : vector) {
+      markDirty(values, value);
+    }
+  }
+
+  if constexpr (TypeProps<T>::identified) {
+    // Snapshots that predate the sequence fall back to the highest id present
+    advance(values.sequence, sequence);
+    for (const auto & value : vector) {
+      advance(values.sequence, value.id() + 1);
+    }
+  }
+
+  values.reindex();
+  values.entries->measure();
+  if constexpr (TypeProps<T>::timed) {
+    values.entries->order();
+  }
+  if constexpr (TypeProps<T>::aggregated) {
+    values.rollup.clear();
+    values.entries->forEach([&values](const T & value) { values.rollup.add(value); });
+  }
+
+  if (!FileHandle<std::ifstream>::exists(directory, TypeProps<T>::journal)) return migrate;
 
-    auto entry = parseValue<T>(buffer);
-    if (!entry) {
-      spdlog::error("Malformed value entry {:s}", buffer);
-      continue;
+  auto truncated = false;
+  {
+    MappedFile mapped(directory, TypeProps<T>::journal);
+    if (!mapped.good()) return migrate;
+
+    // An entry cut off mid-append has no newline yet, and a prefix of it may still parse as
+    // another value. It is left out, and compacting drops it from the file
+    auto journal = mapped.view();
+    const auto terminated = journal.rfind('\n');
+    const auto complete = terminated == std::string_view::npos ? 0 : terminated + 1;
+    if (complete < journal.size()) {
+      spdlog::warn("Dropping unterminated journal entry at {:s}: {:s}", mapped.path, journal.substr(complete));
+      journal.remove_suffix(journal.size() - complete);
+      truncated = true;
+    }
+
+    // Replay is idempotent for types with ids, so that a crash between a compaction's
+    // snapshot and its journal truncation does not duplicate entries. Other types may hold
+    // equal values on purpose, so every addition is applied
+    parser::forEachLine(journal, [&](std::string_view line, std::size_t number) {
+      std::size_t column{1};
+      std::optional<T> entry;
+      if (line.size() > 2 && line[1] == '\t' && (line[0] == '+' || line[0] == '-')) {
+        entry = parser::parse<T>(line.substr(2), column);
+        column += 2;
+      }
+
+      if (!entry) {
+        spdlog::error("Malformed journal entry at {:s}:{:d}:{:d}: {:s}", mapped.path, number, column, line);
+        return;
+      }
+
+      // Removals count too, so that a removed id is not handed out again
+      if constexpr (TypeProps<T>::identified) {
+        advance(values.sequence, entry->id() + 1);
+      }
+
+      if (line[0] == '+') {
+        if (!TypeProps<T>::identified || !values.find(*entry)) markDirty(values, values.insert(std::move(*entry)));
+      } else {
+        if (const auto existing = values.find(*entry)) {
+          markDirty(values, vector[*existing]);
+          values.erase(*existing);
+        }
+      }
+
+      ++values.journaled;
+    });
+  }
+
+  return migrate || truncated || values.journaled > 0;
+}
+
+template <typename T>
+bool Storage::refresh(const User & user, LockedVector<T> & values) {
+  for (auto attempt = 0; attempt < constant::storage::RELOAD_ATTEMPTS; ++attempt) {
+    std::uint64_t version;
+    {
+      std::lock_guard lock{values.mutex};
+      version = values.version;
     }
 
-    vector.emplace_back(std::move(*entry));
+    // Make sure the files reflect every mutation up to this version
+    drain();
+
+    LockedVector<T> fresh;
+    read(user, fresh);
+
+    std::lock_guard lock{values.mutex};
+    if (values.version != version) continue;
+
+    // Compaction is left to the next journal flush so that readers never wait on
+    // snapshot I/O. The previous generation is released with its last reader
+    std::swap(values.entries, fresh.entries);
+    std::swap(values.index, fresh.index);
+    std::swap(values.dirty, fresh.dirty);
+    std::swap(values.rollup, fresh.rollup);
+    advance(values.sequence, fresh.sequence.load());
+    values.journaled = fresh.journaled;
+    ++values.version;
+    return true;
   }
+
+  // Mutations still queued would be lost by reading the files, so the queue is drained
+  // until none are left for these values. Writers that never pause would keep it from
+  // ever emptying, in which case the values are left as they are
+  spdlog::warn("Reloading {:s} for {:s} under lock after concurrent mutations", TypeProps<T>::path, user.name);
+  for (auto attempt = 0; attempt < constant::storage::RELOAD_ATTEMPTS; ++attempt) {
+    drain();
+
+    std::lock_guard lock{values.mutex};
+    if (values.queued > 0) continue;
+
+    load(user, values);
+    ++values.version;
+    return true;
+  }
+
+  spdlog::error("Gave up reloading {:s} for {:s}, mutations kept coming", TypeProps<T>::path, user.name);
+  return false;
 }
@@ -1,187 +1,1167 @@
 #pragma once
 
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <fstream>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 
+#include "compression.hpp"
 #include "constants.hpp"
 #include "file_handle.hpp"
 #include "format.hpp"
 #include "model.hpp"
+#include "rollup.hpp"
+
+enum class Durability : std::uint8_t {
+  // Leave syncing to the operating system
+  None = 0,
+  // Sync journals every SYNC_INTERVAL
+  Interval = 1,
+  // Acknowledge mutations only once their journal is synced
+  EveryWrite = 2,
+};
 
 class Storage {
 private:
+  // Removed values are left in place as tombstones until purged, so positions stay valid
+  template <typename T>
+  struct Entries {
+    std::vector<T> values;
+    std::vector<bool> removed;
+    std::size_t tombstones{0};
+    // Serialized length of the live values, kept up to date so responses can be sized
+    // before serializing
+    std::size_t length{0};
+    // Positions ordered by millis then id, only kept for timed types. Removed values stay
+    // in it until purged, as they do in values
+    std::vector<std::size_t> chronological;
+    // The same order split by skull, only kept for aggregated types
+    std::unordered_map<std::uint32_t, std::vector<std::size_t>> bySkull;
+
+    [[nodiscard]]
+    inline bool empty() const {
+      return values.size() == tombstones;
+    }
+
+    [[nodiscard]]
+    inline std::size_t size() const {
+      return values.size() - tombstones;
+    }
+
+    // Exact length of the JSON array
+    [[nodiscard]]
+    inline std::size_t jsonSize() const {
+      return empty() ? 2 : length + size() + 1;
+    }
+
+    void measure() {
+      length = 0;
+      forEach([this](const T & value) { length += format::jsonSize(value); });
+    }
+
+    template <typename F>
+    void forEach(F && function) const {
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        if (!removed[i]) function(values[i]);
+      }
+    }
+
+    [[nodiscard]]
+    inline std::pair<long, std::uint32_t> keyOf(std::size_t position) const {
+      return {values[position].millis(), values[position].id()};
+    }
+
+    void order() {
+      chronological.resize(values.size());
+      std::iota(chronological.begin(), chronological.end(), std::size_t{0});
+      std::sort(chronological.begin(), chronological.end(), [this](std::size_t lhs, std::size_t rhs) {
+        return keyOf(lhs) < keyOf(rhs);
+      });
+
+      if constexpr (TypeProps<T>::aggregated) {
+        bySkull.clear();
+        for (const auto position : chronological) {
+          bySkull[values[position].skull()].push_back(position);
+        }
+      }
+    }
+
+    void place(std::size_t position) {
+      place(chronological, position);
+      if constexpr (TypeProps<T>::aggregated) {
+        place(bySkull[values[position].skull()], position);
+      }
+    }
+
+  private:
+    // Values mostly arrive in order, which only appends
+    void place(std::vector<std::size_t> & order, std::size_t position) const {
+      const auto key = keyOf(position);
+      if (order.empty() || keyOf(order.back()) < key) {
+        order.push_back(position);
+        return;
+      }
+
+      const auto after = std::upper_bound(order.cbegin(), order.cend(), key, [this](const auto & key, std::size_t position) {
+        return key < keyOf(position);
+      });
+      order.insert(after, position);
+    }
+  };
+
   template <typename T>
   struct LockedVector {
     std::mutex mutex;
-    std::vector<T> vector;
+    // Readers take a reference and serialize it without holding the lock
+    std::shared_ptr<Entries<T>> entries;
+    // Positions of live values by id, only kept for types with ids
+    std::unordered_map<std::uint32_t, std::size_t> index;
+    std::size_t journaled{0};
+    // Mutations enqueued but not journaled yet, which reading the files would miss
+    std::size_t queued{0};
+    std::set<std::int32_t> dirty;
+    // Bumped under the lock on every change, but may be read without it
+    std::atomic<std::uint64_t> version{0};
+    // Serialized values as of jsonVersion, shared with every response that sends them
+    std::shared_ptr<const std::string> json;
+    std::uint64_t jsonVersion{0};
+    // Compressed copies of json by encoding, dropped whenever json is replaced
+    std::array<std::shared_ptr<const std::string>, compression::ENCODING_COUNT> compressed;
+    // Next id to allocate, never lowered so that removed ids are not handed out again
+    std::atomic<std::uint32_t> sequence{1};
+    // Only kept for aggregated types
+    Rollup rollup;
+
+    LockedVector() : entries{std::make_shared<Entries<T>>()} {}
+
+    // The methods below must be called while holding the lock
+
+    // Copies the entries first if a reader still references them, so snapshots handed
+    // out are never mutated
+    Entries<T> & edit() {
+      // New references are only taken under the lock, so the count cannot grow here
+      if (entries.use_count() > 1) {
+        auto copy = std::make_shared<Entries<T>>();
+        copy->values.reserve(entries->values.capacity());
+        for (const auto & value : entries->values) {
+          copy->values.emplace_back(value.clone());
+        }
+        copy->removed = entries->removed;
+        copy->tombstones = entries->tombstones;
+        copy->length = entries->length;
+        copy->chronological = entries->chronological;
+        copy->bySkull = entries->bySkull;
+        entries = std::move(copy);
+      }
+      return *entries;
+    }
+
+    // Rebuilds the bookkeeping for freshly loaded values. Entries must not be shared
+    void reindex() {
+      entries->removed.assign(entries->values.size(), false);
+      entries->tombstones = 0;
+
+      if constexpr (TypeProps<T>::identified) {
+        index.clear();
+        index.reserve(entries->values.size());
+        for (std::size_t i = 0; i < entries->values.size(); ++i) {
+          index[entries->values[i].id()] = i;
+        }
+      }
+    }
+
+    [[nodiscard]]
+    std::optional<std::size_t> find(const T & value) const {
+      if constexpr (TypeProps<T>::identified) {
+        const auto position = index.find(value.id());
+        if (position == index.cend()) return {};
+        return position->second;
+      } else {
+        for (std::size_t i = 0; i < entries->values.size(); ++i) {
+          if (!entries->removed[i] && entries->values[i] == value) return i;
+        }
+        return {};
+      }
+    }
 
-    LockedVector(std::vector<T> && vector) : vector{std::move(vector)} {}
+    const T & insert(T && value) {
+      auto & current = edit();
+      const auto & entry = current.values.emplace_back(std::move(value));
+      current.removed.push_back(false);
+      current.length += format::jsonSize(entry);
+
+      if constexpr (TypeProps<T>::identified) {
+        index[entry.id()] = current.values.size() - 1;
+      }
+      if constexpr (TypeProps<T>::timed) {
+        current.place(current.values.size() - 1);
+      }
+      if constexpr (TypeProps<T>::aggregated) {
+        rollup.add(entry);
+      }
+      return entry;
+    }
+
+    void erase(std::size_t position) {
+      auto & current = edit();
+      current.removed[position] = true;
+      ++current.tombstones;
+      current.length -= format::jsonSize(current.values[position]);
+
+      if constexpr (TypeProps<T>::aggregated) {
+        rollup.remove(current.values[position]);
+      }
+
+      if constexpr (TypeProps<T>::identified) {
+        index.erase(current.values[position].id());
+      }
+    }
+
+    // Drops the tombstones into a new generation, readers keep the previous one
+    void purge() {
+      const auto shared = entries.use_count() > 1;
+      auto purged = std::make_shared<Entries<T>>();
+      purged->values.reserve(entries->size());
+      std::vector<std::size_t> moved(TypeProps<T>::timed ? entries->values.size() : 0);
+      for (std::size_t i = 0; i < entries->values.size(); ++i) {
+        if (entries->removed[i]) continue;
+        if constexpr (TypeProps<T>::timed) moved[i] = purged->values.size();
+        purged->values.emplace_back(shared ? entries->values[i].clone() : std::move(entries->values[i]));
+      }
+
+      // Survivors keep their relative order, so the index only needs renumbering
+      if constexpr (TypeProps<T>::timed) {
+        purged->chronological.reserve(purged->values.size());
+        for (const auto position : entries->chronological) {
+          if (!entries->removed[position]) purged->chronological.push_back(moved[position]);
+        }
+      }
+      if constexpr (TypeProps<T>::aggregated) {
+        for (const auto & [skull, positions] : entries->bySkull) {
+          std::vector<std::size_t> survivors;
+          for (const auto position : positions) {
+            if (!entries->removed[position]) survivors.push_back(moved[position]);
+          }
+          if (!survivors.empty()) purged->bySkull.emplace(skull, std::move(survivors));
+        }
+      }
+
+      purged->length = entries->length;
+      entries = std::move(purged);
+      reindex();
+    }
 
-    LockedVector(const std::vector<T> &) = delete;
     LockedVector(LockedVector &&) = default;
     LockedVector(const LockedVector &) = delete;
     LockedVector & operator=(const LockedVector &) = delete;
   };
 
+  static constexpr const unsigned char TYPE_COUNT = 3;
+
+  struct Residency {
+    std::mutex mutex;
+    std::atomic<unsigned char> loading{TYPE_COUNT};
+    std::atomic<bool> resident{false};
+    std::atomic<std::size_t> pins{0};
+    std::atomic<std::uint64_t> lastUse{0};
+    std::size_t bytes{0};
+  };
+
+  // Latest mutations of a user, already serialized, so that clients can catch up without
+  // fetching everything again. Sequences continue from horizon, which is where the
+  // retained changes start
+  struct ChangeFeed {
+    std::mutex mutex;
+    std::deque<std::pair<std::uint64_t, std::string>> changes;
+    std::uint64_t sequence;
+    std::uint64_t horizon;
+
+    explicit ChangeFeed(std::uint64_t start) : sequence{start}, horizon{start} {}
+  };
+
+  // Holds a directory per user
+  const std::string mRoot;
+  std::deque<std::string> mUserNames;
+  std::unordered_map<User, Residency> mResidency;
+  std::unordered_map<User, ChangeFeed> mFeeds;
   std::unordered_map<User, LockedVector<Skull>> mSkulls;
   std::unordered_map<User, LockedVector<Quick>> mQuicks;
   std::unordered_map<User, LockedVector<Occurrence>> mOccurrences;
 
+  struct PendingEntries {
+    std::vector<std::string> skulls;
+    std::vector<std::string> quicks;
+    std::vector<std::string> occurrences;
+  };
+
+  std::mutex mPendingMutex;
+  std::condition_variable mPendingCondition;
+  std::condition_variable mDrainedCondition;
+  std::unordered_map<std::string, PendingEntries> mPending;
+  std::size_t mPendingCount{0};
+  // Room taken in the queue by mutations that are yet to enqueue
+  std::size_t mReserved{0};
+  // Callers waiting in drain, the writer skips coalescing for them
+  std::size_t mDraining{0};
+  bool mStopping{false};
+
+  Durability mDurability{Durability::Interval};
+  std::chrono::milliseconds mFlushLatency{constant::storage::FLUSH_LATENCY};
+  std::uint64_t mEnqueued{0};
+  std::uint64_t mDurable{0};
+  std::condition_variable mDurableCondition;
+  // Mutations yet to learn whether they are durable, and the batches that failed to reach
+  // the disk as (previous, last] sequences, kept until none of them is waiting anymore
+  std::size_t mAwaiting{0};
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> mFailed;
+
+  // A budget of zero keeps every user resident
+  std::size_t mMemoryBudget{0};
+  std::atomic<std::size_t> mResidentBytes{0};
+  std::atomic<std::uint64_t> mClock{0};
+  std::atomic<std::size_t> mHits{0};
+  std::atomic<std::size_t> mMisses{0};
+  std::atomic<std::size_t> mEvictions{0};
+  std::mutex mEvictionMutex;
+
+  std::thread mLoader;
+  std::thread mWriter;
+
   template <typename T>
   struct TypeProps {
   };
 
+  // Must be called while holding the lock of the values, so that changes are published in
+  // the order they were applied
+  template <typename T>
+  void publish(const User & user, const char * operation, const T & value) {
+    const auto feed = mFeeds.find(user);
+    if (feed == mFeeds.end()) return;
+
+    std::lock_guard lock{feed->second.mutex};
+    const auto sequence = ++feed->second.sequence;
+
+    format::writer change;
+    change << R"({"sequence":)" << sequence
+           << R"(,"type":")" << TypeProps<T>::name
+           << R"(","operation":")" << operation
+           << R"(","value":)" << format::json{value} << '}';
+    feed->second.changes.emplace_back(sequence, change.release());
+
+    if (feed->second.changes.size() > constant::storage::CHANGE_FEED_SIZE) {
+      feed->second.horizon = feed->second.changes.front().first;
+      feed->second.changes.pop_front();
+    }
+  }
+
   template <typename T, typename S>
-  static void stream(const std::vector<T> & vector, S & stream) {
+  static void stream(const Entries<T> & entries, S & stream) {
     stream << '[';
-    auto end = vector.cend() - 1;
-    for (auto it = vector.cbegin(); it != end; ++it) {
-      stream << format::json{*it} << ',';
+    auto first = true;
+    entries.forEach([&](const T & value) {
+      if (!first) stream << ',';
+      first = false;
+      stream << format::json{value};
+    });
+    stream << ']';
+  }
+
+  template <typename T>
+  static std::string record(char operation, const T & value) {
+    std::stringstream entry;
+    entry << operation << '\t' << format::tsv{value};
+    return entry.str();
+  }
+
+  template <typename T>
+  static std::string segmentPath(std::int32_t segment, const char * const directory = TypeProps<T>::segments) {
+    return fmt::format("{:s}/{:04d}-{:02d}.bin", directory, segment / 12, segment % 12 + 1);
+  }
+
+  template <typename T>
+  static std::optional<std::int32_t> segmentOf(const std::string & path) {
+    int year;
+    int month;
+    const auto name = path.c_str() + std::char_traits<char>::length(TypeProps<T>::segments) + 1;
+    if (std::sscanf(name, "%04d-%02d.bin", &year, &month) != 2 || month < 1 || month > 12) return {};
+
+    // The pattern accepts any suffix, such as that of a snapshot being written
+    const auto segment = year * 12 + month - 1;
+    if (segmentPath<T>(segment) != path) return {};
+    return segment;
+  }
+
+  static void advance(std::atomic<std::uint32_t> & sequence, std::uint32_t next) {
+    auto current = sequence.load();
+    while (current < next && !sequence.compare_exchange_weak(current, next)) {}
+  }
+
+  template <typename T>
+  static void markDirty(LockedVector<T> & values, const T & value) {
+    if constexpr (TypeProps<T>::segmented) {
+      values.dirty.insert(TypeProps<T>::segment(value));
+    }
+  }
+
+  std::string directoryOf(const std::string & user) const {
+    return mRoot + '/' + user;
+  }
+
+  template <typename T, typename P>
+  bool saveRecords(const std::string & directory,
+                   const char * const fileName,
+                   const Entries<T> & entries,
+                   std::uint32_t sequence,
+                   P && predicate) const {
+    SnapshotHandle handle(directory, fileName, std::ios::binary);
+    if (!handle.good()) return false;
+
+    const auto header = format::binaryHeader::of<T>(sequence);
+    handle.file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    entries.forEach([&](const T & value) {
+      if (predicate(value)) handle.file << format::binary{value};
+    });
+
+    return handle.commit(mDurability != Durability::None);
+  }
+
+  // Returns whether every snapshot was replaced
+  template <typename T>
+  bool save(const std::string & directory, LockedVector<T> & values) const {
+    const std::uint32_t sequence = TypeProps<T>::identified ? values.sequence.load() : 0;
+
+    if constexpr (TypeProps<T>::segmented) {
+      // Without a segment directory every segment is dirty, as when migrating. They are
+      // written to a staging directory that is renamed into place once complete, so that
+      // a crash never leaves only some of them behind
+      const auto staged = !FileHandle<std::ofstream>::exists(directory, TypeProps<T>::segments);
+      const auto target = staged ? TypeProps<T>::staging : TypeProps<T>::segments;
+      if (staged) FileHandle<std::ofstream>::remove(directory, target);
+      FileHandle<std::ofstream>::createDirectory(directory, target);
+
+      // Only segments touched since the last compaction are rewritten, which in the
+      // steady state is just the current month. Failed ones stay dirty for the next try
+      auto complete = true;
+      for (auto segment = values.dirty.begin(); segment != values.dirty.end();) {
+        const auto month = *segment;
+        const auto path = segmentPath<T>(month, target);
+        const auto saved = saveRecords(directory, path.c_str(), *values.entries, sequence, [month](const T & value) {
+          return TypeProps<T>::segment(value) == month;
+        });
+
+        complete = complete && saved;
+        segment = saved && !staged ? values.dirty.erase(segment) : std::next(segment);
+      }
+      if (!staged) return complete;
+
+      if (!complete || !FileHandle<std::ofstream>::rename(directory, target, TypeProps<T>::segments, mDurability != Durability::None)) {
+        return false;
+      }
+      values.dirty.clear();
+
+      // Only read while there are no segments, kept aside in case they failed to load
+      for (const auto & [legacy, migrated] : TypeProps<T>::legacy) {
+        if (FileHandle<std::ofstream>::exists(directory, legacy)) {
+          FileHandle<std::ofstream>::rename(directory, legacy, migrated, mDurability != Durability::None);
+        }
+      }
+      return true;
+    } else if constexpr (TypeProps<T>::binary) {
+      return saveRecords(directory, TypeProps<T>::snapshot, *values.entries, sequence, [](const T &) { return true; });
+    } else {
+      SnapshotHandle handle(directory, TypeProps<T>::path);
+      if (!handle.good()) return false;
+
+      values.entries->forEach([&](const T & value) { handle.file << format::tsv{value} << '\n'; });
+
+      if (!handle.commit(mDurability != Durability::None)) return false;
+
+      // Plain text snapshots have no header, so the sequence is kept alongside
+      if constexpr (TypeProps<T>::identified) {
+        SnapshotHandle sequenceHandle(directory, TypeProps<T>::sequence);
+        if (!sequenceHandle.good()) return false;
+
+        sequenceHandle.file << sequence << '\n';
+        return sequenceHandle.commit(mDurability != Durability::None);
+      }
+      return true;
+    }
+  }
+
+  // The journal is the only other copy of its mutations, so it is only truncated once
+  // the snapshot holds them
+  template <typename T>
+  bool compact(const std::string & directory, LockedVector<T> & values) const {
+    if (!save(directory, values)) return false;
+
+    FileHandle<std::ofstream> handle(directory, TypeProps<T>::journal);
+    values.journaled = 0;
+    return true;
+  }
+
+  // Returns whether the entries reached the journal or a snapshot, adding the journal to
+  // touched when appended to. Entries still go to the journal when compacting fails. Memory
+  // is ahead of the journal while mutations are still queued, and those would be journaled
+  // again on top of a snapshot that holds them, so compaction waits for a flush that leaves
+  // none behind
+  template <typename T>
+  bool journal(const std::string & directory,
+               const std::vector<std::string> & entries,
+               LockedVector<T> & values,
+               std::vector<std::string> & touched) const {
+    values.journaled += entries.size();
+    if (values.journaled >= constant::storage::COMPACTION_THRESHOLD && values.queued == 0 && compact(directory, values)) {
+      return true;
+    }
+
+    FileHandle<std::ofstream> handle(directory, TypeProps<T>::journal, std::ios::app);
+    if (!handle.good()) return false;
+
+    for (const auto & entry : entries) {
+      handle.file << entry << '\n';
+    }
+
+    handle.file.flush();
+    if (!handle.good()) return false;
+
+    touched.emplace_back(handle.path);
+    return true;
+  }
+
+  // Returns whether the entries reached the disk
+  template <typename T>
+  bool flush(const std::string & user, const std::vector<std::string> & entries, std::vector<std::string> & touched) {
+    if (entries.empty()) return true;
+
+    const auto values = (this->*TypeProps<T>::map).find(User{user});
+    if (values == (this->*TypeProps<T>::map).cend()) return true;
+
+    std::lock_guard lock{values->second.mutex};
+    values->second.queued -= entries.size();
+    const auto journaled = journal(directoryOf(user), entries, values->second, touched);
+
+    // Done here so that request threads never pay for it
+    if (values->second.entries->tombstones >= constant::storage::TOMBSTONE_THRESHOLD) {
+      values->second.purge();
     }
-    stream << format::json{*end} << ']';
+    return journaled;
+  }
+
+  // Waits for room in the queue. Must be called without holding the vector lock, since
+  // the writer may need it to make room
+  void reserve() {
+    std::unique_lock lock{mPendingMutex};
+    mDrainedCondition.wait(lock, [this] {
+      return mStopping || mPendingCount + mReserved < constant::storage::MAX_PENDING;
+    });
+    ++mReserved;
   }
 
+  // Gives back the room of a mutation that turned out to have nothing to enqueue
+  void unreserve() {
+    {
+      std::lock_guard lock{mPendingMutex};
+      --mReserved;
+    }
+    mDrainedCondition.notify_one();
+  }
+
+  // Takes the room reserved beforehand, so it never waits. Must be called while holding
+  // the vector lock so that the journal keeps the same order as the mutations applied in
+  // memory. Returns the sequence number of the entry
   template <typename T>
-  static void save(const std::string && user,
-                   const std::vector<T> * const vector,
-                   std::unique_lock<std::mutex> &&) {
-    FileHandle<std::ofstream> handle(user, TypeProps<T>::path);
-    if (!handle.good()) return;
+  std::uint64_t enqueue(const User & user, LockedVector<T> & values, std::string && entry) {
+    ++values.queued;
 
-    for (const auto & value : *vector) {
-      handle.file << format::tsv{value} << '\n';
+    std::lock_guard lock{mPendingMutex};
+    --mReserved;
+    (mPending[user.name].*TypeProps<T>::pending).emplace_back(std::move(entry));
+    ++mPendingCount;
+    if (mDurability == Durability::EveryWrite) ++mAwaiting;
+    mPendingCondition.notify_one();
+    return ++mEnqueued;
+  }
+
+  // Must be called without holding the vector lock, once for every enqueue. Returns whether
+  // the mutation is on disk, which is only told when every write is synced. A failed batch
+  // fails every mutation in it
+  bool awaitDurable(std::uint64_t sequence) {
+    if (mDurability != Durability::EveryWrite) return true;
+
+    std::unique_lock lock{mPendingMutex};
+    mDurableCondition.wait(lock, [this, sequence] { return mStopping || mDurable >= sequence; });
+
+    const auto durable = mDurable >= sequence
+                         && std::none_of(mFailed.cbegin(), mFailed.cend(), [sequence](const auto & batch) {
+                              return batch.first < sequence && sequence <= batch.second;
+                            });
+    if (--mAwaiting == 0) mFailed.clear();
+    return durable;
+  }
+
+  template <typename T>
+  static std::size_t footprint(LockedVector<T> & values) {
+    std::lock_guard lock{values.mutex};
+    constexpr auto node = sizeof(std::uint32_t) + sizeof(std::size_t) + 2 * sizeof(void *);
+    auto json = values.json ? values.json->capacity() : 0;
+    for (const auto & compressed : values.compressed) {
+      if (compressed) json += compressed->capacity();
     }
+    const auto rollup = values.rollup.size() * (sizeof(Rollup::Total) + node);
+    return values.entries->values.capacity() * sizeof(T) + values.index.size() * node + json + rollup;
+  }
+
+  template <typename T>
+  static void unload(LockedVector<T> & values) {
+    std::lock_guard lock{values.mutex};
+    values.entries = std::make_shared<Entries<T>>();
+    values.index.clear();
+    values.json.reset();
+    values.compressed.fill(nullptr);
+    values.rollup.clear();
+    values.journaled = 0;
+    values.dirty.clear();
   }
 
+  std::size_t footprint(const User & user);
+  void populate();
+  void persist();
+  // Blocks until the writer has flushed every mutation queued so far
+  void drain();
+  void evict();
+
+  // Reads the files into values and returns whether the journal should be compacted
   template <typename T>
-  static void load(const User & user, std::vector<T> & vector);
+  bool read(const User & user, LockedVector<T> & values);
+
+  template <typename T>
+  void load(const User & user, LockedVector<T> & values);
+
+  // Reloads without holding the lock and swaps the result in. False if writes never let up
+  template <typename T>
+  bool refresh(const User & user, LockedVector<T> & values);
 
 public:
-  Storage();
+  explicit Storage(std::string root = constant::file::ROOT);
+  ~Storage();
+
+  Storage(const Storage &) = delete;
+  Storage & operator=(const Storage &) = delete;
+
+  // Keeps a user resident for as long as it is alive
+  class Pin {
+    friend class Storage;
+
+    Storage * storage{nullptr};
+    const User * user{nullptr};
+    Residency * residency{nullptr};
+
+    Pin() = default;
+    Pin(Storage * storage, const User * user, Residency * residency)
+        : storage{storage}, user{user}, residency{residency} {}
+
+  public:
+    Pin(Pin && other) noexcept
+        : storage{std::exchange(other.storage, nullptr)},
+          user{std::exchange(other.user, nullptr)},
+          residency{std::exchange(other.residency, nullptr)} {}
+    Pin(const Pin &) = delete;
+    Pin & operator=(const Pin &) = delete;
+    Pin & operator=(Pin &&) = delete;
+    ~Pin();
+
+    explicit operator bool() const {
+      return storage != nullptr;
+    }
+  };
+
+  // Starts loading every user up front if memoryBudget is zero, otherwise users are
+  // loaded on first access and the least recently used ones are evicted past the budget
+  void start(std::size_t memoryBudget,
+             Durability durability,
+             std::chrono::milliseconds flushLatency = constant::storage::FLUSH_LATENCY);
+
+  // Blocks until every user has been loaded. Must not be called concurrently
+  void wait();
+
+  // Returns an empty pin if the user is not ready to be served
+  [[nodiscard]]
+  Pin pin(const User & user);
+
+  void logStats() const;
 
   [[nodiscard]]
   inline bool authorized(const User & user) const {
     return user != constant::user::UNKNOWN && mSkulls.find(user) != mSkulls.cend();
   }
 
+  // Ids are unique per user and type even across concurrent requests
   template <typename T>
   [[nodiscard]]
-  unsigned short nextId(const User & user) {
+  std::uint32_t nextId(const User & user) {
+    static_assert(TypeProps<T>::identified, "Type has no id");
+
     const auto values = (this->*TypeProps<T>::map).find(user);
     if (values == (this->*TypeProps<T>::map).cend()) return 1;
-    if (values->second.vector.empty()) return 1;
-
-    std::lock_guard lock{values->second.mutex};
 
-    return values->second.vector.back().id() + 1;
+    return values->second.sequence.fetch_add(1, std::memory_order_relaxed);
   }
 
+  // Immutable view of a user's values which can be serialized without any lock, for
+  // however long it takes. It keeps the data alive even if the user is evicted meanwhile
+  template <typename T>
+  using Snapshot = std::shared_ptr<const Entries<T>>;
+
   template <typename T>
   [[nodiscard]]
-  std::string get(const User & user) {
+  Snapshot<T> snapshot(const User & user) {
     const auto values = (this->*TypeProps<T>::map).find(user);
-    if (values == (this->*TypeProps<T>::map).cend()) return "[]";
-    if (values->second.vector.empty()) return "[]";
+    if (values == (this->*TypeProps<T>::map).cend()) return {};
 
     std::lock_guard lock{values->second.mutex};
-
-    std::stringstream output;
-    stream(values->second.vector, output);
-    return output.str();
+    return values->second.entries;
   }
 
   template <typename T, typename S>
-  void stream(const User & user, S & output) {
-    const auto values = (this->*TypeProps<T>::map).find(user);
-    if (values == (this->*TypeProps<T>::map).cend() || values->second.vector.empty()) {
+  static void stream(const Snapshot<T> & values, S & output) {
+    if (!values || values->empty()) {
       output << "[]";
       return;
     }
 
+    stream(*values, output);
+  }
+
+  // Changes whenever the values do, without touching them or taking their lock. It
+  // only grows within a process, so it must be read before the values it describes
+  template <typename T>
+  [[nodiscard]]
+  std::uint64_t version(const User & user) const {
+    const auto values = (this->*TypeProps<T>::map).find(user);
+    if (values == (this->*TypeProps<T>::map).cend()) return 0;
+
+    return values->second.version.load();
+  }
+
+  // Serialized on the first read after a mutation, later reads share the same buffer
+  template <typename T>
+  [[nodiscard]]
+  std::shared_ptr<const std::string> json(const User & user) {
+    const auto values = (this->*TypeProps<T>::map).find(user);
+    if (values == (this->*TypeProps<T>::map).cend()) return std::make_shared<const std::string>("[]");
+
+    Snapshot<T> entries;
+    std::uint64_t version;
+    {
+      std::lock_guard lock{values->second.mutex};
+      if (values->second.json && values->second.jsonVersion == values->second.version) {
+        return values->second.json;
+      }
+
+      entries = values->second.entries;
+      version = values->second.version;
+    }
+
+    // Sized exactly, so the buffer is allocated once and kept without slack
+    format::writer output;
+    output.reserve(entries->jsonSize());
+    stream<T>(entries, output);
+    auto json = std::make_shared<const std::string>(output.release());
+
     std::lock_guard lock{values->second.mutex};
+    if (values->second.version == version) {
+      values->second.json = json;
+      values->second.jsonVersion = version;
+      values->second.compressed.fill(nullptr);
+    }
+    return json;
+  }
+
+  // Compresses the serialized values once per version and encoding
+  template <typename T>
+  [[nodiscard]]
+  std::shared_ptr<const std::string> compressed(const User & user,
+                                                const std::shared_ptr<const std::string> & json,
+                                                compression::Encoding encoding,
+                                                int level) {
+    if (encoding == compression::Encoding::Identity) return json;
+
+    const auto position = static_cast<std::size_t>(encoding);
+    const auto values = (this->*TypeProps<T>::map).find(user);
+    if (values != (this->*TypeProps<T>::map).cend()) {
+      std::lock_guard lock{values->second.mutex};
+      if (values->second.json == json && values->second.compressed[position]) {
+        return values->second.compressed[position];
+      }
+    }
+
+    auto compressed = std::make_shared<const std::string>(compression::compress(*json, encoding, level));
 
-    stream(values->second.vector, output);
+    if (values != (this->*TypeProps<T>::map).cend()) {
+      // Only kept if json is still the cached one, otherwise it is already stale
+      std::lock_guard lock{values->second.mutex};
+      if (values->second.json == json) {
+        values->second.compressed[position] = compressed;
+      }
+    }
+    return compressed;
   }
 
+  template <typename T, typename S>
+  static void pack(const Snapshot<T> & values, S & output) {
+    format::pack::array(output, values ? values->size() : 0);
+    if (!values) return;
+
+    values->forEach([&output](const T & value) { output << format::msgpack{value}; });
+  }
+
+  // Serializes a snapshot a piece at a time, like stream or pack would in one go, for
+  // bodies sent while they are produced. Each call appends values until output holds at
+  // least limit bytes, and returns true once the whole array was written
   template <typename T>
-  bool add(const User & user, T && value) {
+  class Serializer {
+  private:
+    const Snapshot<T> mValues;
+    const bool mPacked;
+    std::size_t mPosition{0};
+    bool mStarted{false};
+    bool mFirst{true};
+
+  public:
+    Serializer(Snapshot<T> values, bool packed)
+        : mValues{std::move(values)},
+          mPacked{packed} {}
+
+    template <typename S>
+    bool operator()(S & output, std::size_t limit) {
+      if (!mStarted) {
+        mStarted = true;
+        if (mPacked) {
+          format::pack::array(output, mValues ? mValues->size() : 0);
+        } else {
+          output << '[';
+        }
+      }
+
+      const auto count = mValues ? mValues->values.size() : 0;
+      for (; mPosition < count && output.size() < limit; ++mPosition) {
+        if (mValues->removed[mPosition]) continue;
+
+        const auto & value = mValues->values[mPosition];
+        if (mPacked) {
+          output << format::msgpack{value};
+          continue;
+        }
+        if (!mFirst) output << ',';
+        mFirst = false;
+        output << format::json{value};
+      }
+
+      if (mPosition < count) return false;
+      if (!mPacked) output << ']';
+      return true;
+    }
+  };
+
+  // Not cached, since counting packed values is cheap enough to size the buffer exactly
+  template <typename T>
+  [[nodiscard]]
+  std::string msgpack(const User & user) {
+    const auto values = snapshot<T>(user);
+
+    format::counter size;
+    pack<T>(values, size);
+
+    format::writer output;
+    output.reserve(size.size());
+    pack<T>(values, output);
+    return output.release();
+  }
+
+  // Identifies the last value of a page of a timed type, the next page starts after it
+  struct Cursor {
+    long millis;
+    std::uint32_t id;
+  };
+
+  struct Range {
+    long from{std::numeric_limits<long>::min()};
+    // Exclusive
+    long to{std::numeric_limits<long>::max()};
+    std::size_t limit{std::numeric_limits<std::size_t>::max()};
+    std::optional<Cursor> after;
+    // Only for aggregated types, narrows the search to the skull's own index
+    std::optional<std::uint32_t> skull;
+  };
+
+  // Visits the values of a timed type within the range in chronological order, by binary
+  // search on the chronological index. Returns where the next page starts if the limit
+  // left values out
+  template <typename T, typename F>
+  static std::optional<Cursor> forRange(const Entries<T> & entries, const Range & range, F && function) {
+    static_assert(TypeProps<T>::timed, "Only timed types have a chronological index");
+
+    static const std::vector<std::size_t> none;
+    const auto * index = &entries.chronological;
+    if constexpr (TypeProps<T>::aggregated) {
+      if (range.skull) {
+        const auto group = entries.bySkull.find(*range.skull);
+        index = group == entries.bySkull.cend() ? &none : &group->second;
+      }
+    }
+
+    const auto & order = *index;
+    const auto before = [&entries](std::size_t position, const std::pair<long, std::uint32_t> & key) {
+      return entries.keyOf(position) < key;
+    };
+    const auto after = [&entries](const std::pair<long, std::uint32_t> & key, std::size_t position) {
+      return key < entries.keyOf(position);
+    };
+
+    const std::pair<long, std::uint32_t> from{range.from, 0};
+    auto cursor = std::lower_bound(order.cbegin(), order.cend(), from, before);
+    if (range.after) {
+      const std::pair<long, std::uint32_t> last{range.after->millis, range.after->id};
+      if (!(last < from)) {
+        cursor = std::upper_bound(order.cbegin(), order.cend(), last, after);
+      }
+    }
+
+    std::size_t count{0};
+    const T * last{nullptr};
+    for (; cursor != order.cend(); ++cursor) {
+      const auto & value = entries.values[*cursor];
+      if (value.millis() >= range.to) break;
+      if (entries.removed[*cursor]) continue;
+
+      if (count == range.limit) {
+        if (!last) break;
+        return Cursor{last->millis(), last->id()};
+      }
+
+      function(value);
+      last = &value;
+      ++count;
+    }
+
+    return {};
+  }
+
+  struct Page {
+    std::string body;
+    std::optional<Cursor> next;
+  };
+
+  // Costs O(log n + k), serialized as a JSON array or packed like msgpack
+  template <typename T>
+  [[nodiscard]]
+  Page page(const User & user, const Range & range, bool packed) {
+    const auto values = snapshot<T>(user);
+    if (!values) return {packed ? std::string{"\x90"} : std::string{"[]"}, {}};
+
+    Page page;
+    std::vector<const T *> selected;
+    page.next = forRange<T>(*values, range, [&selected](const T & value) { selected.push_back(&value); });
+
+    format::writer output;
+    if (packed) {
+      format::counter size;
+      format::pack::array(size, selected.size());
+      for (const auto value : selected) size << format::msgpack{*value};
+
+      output.reserve(size.size());
+      format::pack::array(output, selected.size());
+      for (const auto value : selected) output << format::msgpack{*value};
+    } else {
+      // The average serialized length makes a close guess without formatting twice
+      const auto average = values->empty() ? 0 : values->length / values->size() + 1;
+      output.reserve(2 + selected.size() * (average + 1));
+
+      output << '[';
+      for (std::size_t i = 0; i < selected.size(); ++i) {
+        if (i > 0) output << ',';
+        output << format::json{*selected[i]};
+      }
+      output << ']';
+    }
+
+    page.body = output.release();
+    return page;
+  }
+
+  // Totals of the occurrences within the range per bucket, as [{"start":..,"amount":..,
+  // "count":..}]. Only the occurrences in range are visited, and only those of the skull if
+  // the range names one
+  [[nodiscard]]
+  std::string series(const User & user, Range range, Granularity granularity);
+
+  // Whether json would be served without serializing
+  template <typename T>
+  [[nodiscard]]
+  bool serialized(const User & user) {
     const auto values = (this->*TypeProps<T>::map).find(user);
     if (values == (this->*TypeProps<T>::map).cend()) return false;
 
-    std::unique_lock lock{values->second.mutex};
-    values->second.vector.emplace_back(std::forward<T>(value));
+    std::lock_guard lock{values->second.mutex};
+    return values->second.json && values->second.jsonVersion == values->second.version;
+  }
 
-    std::thread saver{save<T>, std::string{user.name}, &(values->second.vector), std::move(lock)};
-    saver.detach();
-    return true;
+  template <typename T>
+  [[nodiscard]]
+  std::string get(const User & user) {
+    return *json<T>(user);
+  }
+
+  template <typename T, typename S>
+  void stream(const User & user, S & output) {
+    stream<T>(snapshot<T>(user), output);
   }
 
   template <typename T>
-  bool remove(const User & user, T && value) {
+  bool add(const User & user, T && value) {
     const auto values = (this->*TypeProps<T>::map).find(user);
     if (values == (this->*TypeProps<T>::map).cend()) return false;
 
-    std::unique_lock lock{values->second.mutex};
+    reserve();
+    std::uint64_t sequence;
+    {
+      std::lock_guard lock{values->second.mutex};
+      const auto & entry = values->second.insert(std::forward<T>(value));
+      markDirty(values->second, entry);
+      ++values->second.version;
+      publish(user, "add", entry);
 
-    auto entry = std::find(values->second.vector.begin(), values->second.vector.end(), value);
-    if (entry == values->second.vector.end()) return false;
-    values->second.vector.erase(entry);
+      sequence = enqueue<T>(user, values->second, record('+', entry));
+    }
 
-    std::thread saver{save<T>, std::string{user.name}, &(values->second.vector), std::move(lock)};
-    saver.detach();
-    return true;
+    return awaitDurable(sequence);
   }
 
-  bool reload(const User & user) {
-    const auto skull = mSkulls.find(user);
-    if (skull == mSkulls.cend()) return false;
+  template <typename T>
+  bool remove(const User & user, T && value) {
+    const auto values = (this->*TypeProps<T>::map).find(user);
+    if (values == (this->*TypeProps<T>::map).cend()) return false;
 
-    const auto quick = mQuicks.find(user);
-    if (quick == mQuicks.cend()) return false;
+    reserve();
+    std::uint64_t sequence;
+    {
+      std::lock_guard lock{values->second.mutex};
 
-    const auto occurrence = mOccurrences.find(user);
-    if (occurrence == mOccurrences.cend()) return false;
+      const auto position = values->second.find(value);
+      if (!position) {
+        unreserve();
+        return false;
+      }
 
-    std::thread loader{[&](const std::string && user){
-      std::lock_guard skullLock{skull->second.mutex};
-      std::lock_guard quickLock{quick->second.mutex};
-      std::lock_guard occurrenceLock{occurrence->second.mutex};
+      const auto & entry = values->second.entries->values[*position];
+      auto removal = record('-', entry);
+      publish(user, "remove", entry);
+      markDirty(values->second, entry);
+      values->second.erase(*position);
+      ++values->second.version;
 
-      load(user, skull->second.vector);
-      load(user, quick->second.vector);
-      load(user, occurrence->second.vector);
-    }, std::string{user.name}};
-    loader.detach();
+      sequence = enqueue<T>(user, values->second, std::move(removal));
+    }
 
-    return true;
+    return awaitDurable(sequence);
   }
 
+  // Reloads a user from disk, readers keep the previous data meanwhile. False if the user
+  // is not loaded, or if some values could not be reloaded because writes kept coming
+  bool reload(const User & user);
+
+  // Occurrence totals per bucket and skull, as [{"start":..,"skull":..,"amount":..,
+  // "count":..,"value":..}], where value is the amount at the skull's unit price
+  [[nodiscard]]
+  std::string rollup(const User & user,
+                     Granularity granularity,
+                     long from,
+                     long to,
+                     std::optional<std::uint32_t> skull);
+
+  // Changes after since as {"sequence":..,"reset":false,"changes":[..]}. When they are no
+  // longer all retained, or since comes from a previous run, only the current sequence is
+  // given with reset set, and the client must fetch everything. Changes may already be
+  // reflected in data fetched after since, so clients apply them idempotently
+  [[nodiscard]]
+  std::string changes(const User & user, std::optional<std::uint64_t> since);
+
+  // Exact length of what json would return, without serializing
   template <typename T>
   [[nodiscard]]
-  inline std::size_t estimateSize(const User & user) const {
+  std::size_t jsonSize(const User & user) {
     const auto values = (this->*TypeProps<T>::map).find(user);
-    if (values == (this->*TypeProps<T>::map).cend()) return 0;
+    if (values == (this->*TypeProps<T>::map).cend()) return 2;
 
-    return values->second.vector.size() * 50;
+    std::lock_guard lock{values->second.mutex};
+    return values->second.entries->jsonSize();
   }
 };
 
 template <>
 struct Storage::TypeProps<Skull> {
   static constexpr const auto & path = constant::file::SKULL;
+  static constexpr const auto identified = true;
+  static constexpr const auto timed = false;
+  static constexpr const auto aggregated = false;
+  static constexpr const auto name = "skull";
+  static constexpr const auto & sequence = constant::file::sequence::SKULL;
+  static constexpr const auto binary = false;
+  static constexpr const auto segmented = false;
+  static constexpr const auto & journal = constant::file::journal::SKULL;
+  static constexpr auto Storage::PendingEntries::* const pending = &Storage::PendingEntries::skulls;
   static constexpr auto Storage::* const map = &Storage::mSkulls;
 };
 
 template <>
 struct Storage::TypeProps<Quick> {
   static constexpr const auto & path = constant::file::QUICK;
+  static constexpr const auto identified = false;
+  static constexpr const auto timed = false;
+  static constexpr const auto aggregated = false;
+  static constexpr const auto name = "quick";
+  static constexpr const auto binary = true;
+  static constexpr const auto & snapshot = constant::file::binary::QUICK;
+  static constexpr const auto segmented = false;
+  static constexpr const auto & journal = constant::file::journal::QUICK;
+  static constexpr auto Storage::PendingEntries::* const pending = &Storage::PendingEntries::quicks;
   static constexpr auto Storage::* const map = &Storage::mQuicks;
 };
 
 template <>
 struct Storage::TypeProps<Occurrence> {
   static constexpr const auto & path = constant::file::OCCURRENCE;
+  static constexpr const auto identified = true;
+  static constexpr const auto timed = true;
+  static constexpr const auto aggregated = true;
+  static constexpr const auto name = "occurrence";
+  static constexpr const auto binary = true;
+  static constexpr const auto & snapshot = constant::file::binary::OCCURRENCE;
+  static constexpr const auto segmented = true;
+  static constexpr const auto & segments = constant::file::segment::OCCURRENCE;
+  static constexpr const auto & staging = constant::file::staging::OCCURRENCE;
+  static constexpr const std::pair<const char *, const char *> legacy[] = {
+      {constant::file::OCCURRENCE, constant::file::migrated::OCCURRENCE},
+      {constant::file::binary::OCCURRENCE, constant::file::migrated::OCCURRENCE_BINARY},
+  };
+  static constexpr const auto & journal = constant::file::journal::OCCURRENCE;
+  static constexpr auto Storage::PendingEntries::* const pending = &Storage::PendingEntries::occurrences;
   static constexpr auto Storage::* const map = &Storage::mOccurrences;
+
+  // Months since year zero in UTC, the same as the monthly buckets of the rollup
+  static std::int32_t segment(const Occurrence & value) {
+    return static_cast<std::int32_t>(Rollup::bucketOf(value.millis(), Granularity::Month));
+  }
 };
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include "chunk_pool.hpp"
+
+TEST(ChunkPool, acquire_reserves) {
+  ChunkPool pool{1024, 2};
+  const auto buffer = pool.acquire();
+  ASSERT_TRUE(buffer.empty());
+  ASSERT_GE(buffer.capacity(), 1024);
+}
+
+TEST(ChunkPool, shared_buffers_return) {
+  ChunkPool pool{1024, 2};
+  auto buffer = pool.acquire();
+  buffer.append("chunk");
+  const auto data = buffer.data();
+
+  {
+    const auto shared = pool.share(std::move(buffer));
+    ASSERT_EQ(*shared, "chunk");
+    ASSERT_EQ(shared->data(), data);
+  }
+
+  const auto recycled = pool.acquire();
+  ASSERT_TRUE(recycled.empty());
+  ASSERT_EQ(recycled.data(), data);
+}
+
+TEST(ChunkPool, bounded) {
+  ChunkPool pool{1024, 1};
+  auto first = pool.acquire();
+  auto second = pool.acquire();
+  const auto kept = first.data();
+
+  pool.release(std::move(first));
+  pool.release(std::move(second));
+  pool.release(std::string{});
+
+  ASSERT_EQ(pool.acquire().data(), kept);
+}
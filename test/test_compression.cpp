@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <zlib.h>
+
+#include "compression.hpp"
+
+namespace {
+  std::string inflate(const std::string & compressed, compression::Encoding encoding) {
+    z_stream stream{};
+    inflateInit2(&stream, encoding == compression::Encoding::Gzip ? MAX_WBITS + 16 : MAX_WBITS);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(compressed.size());
+
+    std::string output;
+    char buffer[4096];
+    int result;
+    do {
+      stream.next_out = reinterpret_cast<Bytef *>(buffer);
+      stream.avail_out = sizeof(buffer);
+      result = ::inflate(&stream, Z_NO_FLUSH);
+      output.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (result == Z_OK);
+    inflateEnd(&stream);
+
+    EXPECT_EQ(result, Z_STREAM_END);
+    return output;
+  }
+
+  std::string sample() {
+    std::string json{"["};
+    for (auto i = 0; i < 2000; ++i) {
+      json += R"({"id":)" + std::to_string(i) + R"(,"skull":3,"amount":1.5,"millis":1600000000000},)";
+    }
+    json.back() = ']';
+    return json;
+  }
+}
+
+TEST(Compression, negotiate) {
+  using compression::Encoding;
+  ASSERT_EQ(compression::negotiate(""), Encoding::Identity);
+  ASSERT_EQ(compression::negotiate("identity"), Encoding::Identity);
+  ASSERT_EQ(compression::negotiate("gzip"), Encoding::Gzip);
+  ASSERT_EQ(compression::negotiate("deflate"), Encoding::Deflate);
+  ASSERT_EQ(compression::negotiate("gzip, deflate, br"), Encoding::Gzip);
+  ASSERT_EQ(compression::negotiate("deflate, gzip;q=0.5"), Encoding::Deflate);
+  ASSERT_EQ(compression::negotiate("gzip;q=0, deflate"), Encoding::Deflate);
+  ASSERT_EQ(compression::negotiate("gzip; q=0.000"), Encoding::Identity);
+  ASSERT_EQ(compression::negotiate("*"), Encoding::Gzip);
+  ASSERT_EQ(compression::negotiate("*;q=0"), Encoding::Identity);
+  ASSERT_EQ(compression::negotiate("gzip;q=0, *"), Encoding::Deflate);
+}
+
+TEST(Compression, round_trip) {
+  const auto json = sample();
+  for (const auto encoding : {compression::Encoding::Gzip, compression::Encoding::Deflate}) {
+    const auto compressed = compression::compress(json, encoding, 6);
+    ASSERT_LT(compressed.size(), json.size() / 4);
+    ASSERT_EQ(inflate(compressed, encoding), json);
+  }
+}
+
+TEST(Compression, empty) {
+  const auto compressed = compression::compress("", compression::Encoding::Gzip, 6);
+  ASSERT_FALSE(compressed.empty());
+  ASSERT_EQ(inflate(compressed, compression::Encoding::Gzip), "");
+}
+
+TEST(Compression, stream) {
+  const auto json = sample();
+  compression::Stream stream{compression::Encoding::Gzip, 1};
+
+  std::string compressed;
+  for (std::size_t position = 0; position < json.size(); position += 1000) {
+    compressed += stream.push(std::string_view{json}.substr(position, 1000), false);
+  }
+  compressed += stream.push({}, true);
+
+  ASSERT_EQ(inflate(compressed, compression::Encoding::Gzip), json);
+}
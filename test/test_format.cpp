@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "format.hpp"
+#include "model.hpp"
+
+TEST(Writer, numbers) {
+  format::writer writer;
+  writer << std::uint32_t{4294967295} << ',' << -9223372036854775807L << ',' << 3.0f << ',' << 3.2f << ','
+         << 1.23456789f << ',' << 1e7f;
+  ASSERT_EQ(writer.release(), "4294967295,-9223372036854775807,3,3.2,1.23457,1e+07");
+}
+
+TEST(Writer, doubles) {
+  format::writer writer;
+  format::counter counter;
+  for (const auto value : {0.0, 0.1, 2.5, 1e21, -1234.5678}) {
+    writer << value << ',';
+    counter << value << ',';
+  }
+  ASSERT_EQ(counter.size(), writer.size());
+  ASSERT_EQ(writer.release(), "0,0.1,2.5,1e+21,-1234.5678,");
+}
+
+TEST(Writer, matches_stream) {
+  Occurrence occurrence{70000, 2, 1.5f, 1600000000000L};
+  format::writer writer;
+  std::stringstream stream;
+  writer << format::json{occurrence};
+  stream << format::json{occurrence};
+  ASSERT_EQ(writer.release(), stream.str());
+}
+
+TEST(Escaped, plain) {
+  format::writer writer;
+  writer << format::escaped{"plain text"};
+  ASSERT_EQ(writer.release(), "plain text");
+}
+
+TEST(Escaped, special) {
+  format::writer writer;
+  writer << format::escaped{"a\"b\\c\nd\te\x01"};
+  ASSERT_EQ(writer.release(), R"(a\"b\\c\nd\te\u0001)");
+}
+
+TEST(Escaped, skull) {
+  Skull skull{1, "say \"hi\"", "#fff", "a\\b", 2, {}};
+  format::writer writer;
+  skull.json(writer);
+  ASSERT_EQ(writer.release(),
+            R"({"id":1,"name":"say \"hi\"","color":"#fff","icon":"a\\b","unitPrice":2})");
+}
+
+TEST(Counter, matches_writer) {
+  const Skull skull{4294967295, std::string(10, '\x01'), "say \"hi\"", "", -1.17549e-38f, -1.17549e-38f};
+  const Quick quick{80000, 0.1f};
+  const Occurrence occurrence{70000, 2, 1234567.0f, -1600000000000L};
+
+  format::writer writer;
+  writer << format::json{skull};
+  ASSERT_EQ(writer.release().size(), format::jsonSize(skull));
+  writer << format::json{quick};
+  ASSERT_EQ(writer.release().size(), format::jsonSize(quick));
+  writer << format::json{occurrence};
+  ASSERT_EQ(writer.release().size(), format::jsonSize(occurrence));
+}
+
+TEST(Writer, floats_match_stream) {
+  for (const auto value : {0.0f, -0.0f, 0.1f, 0.0001f, 0.00001f, 1.5f, -2.75f, 123456.0f, 999999.5f, 1000000.0f,
+                           1234567.0f, 3.14159265f, 1e-30f, 3.4e38f, 100.001f, 0.000123456f}) {
+    format::writer writer;
+    std::stringstream stream;
+    writer << value;
+    stream << value;
+    ASSERT_EQ(writer.release(), stream.str()) << value;
+  }
+}
+
+TEST(Pack, integers) {
+  format::writer writer;
+  format::pack::integer(writer, std::uint64_t{5});
+  format::pack::integer(writer, std::uint64_t{200});
+  format::pack::integer(writer, std::uint64_t{70000});
+  format::pack::integer(writer, std::int64_t{-3});
+  format::pack::integer(writer, std::int64_t{-200});
+  format::pack::integer(writer, std::int64_t{1600000000000L});
+  ASSERT_EQ(writer.release(), std::string("\x05"
+                                          "\xcc\xc8"
+                                          "\xce\x00\x01\x11\x70"
+                                          "\xfd"
+                                          "\xd1\xff\x38"
+                                          "\xcf\x00\x00\x01\x74\x87\x6e\x80\x00", 21));
+}
+
+TEST(Pack, strings_and_arrays) {
+  format::writer writer;
+  format::pack::array(writer, 2);
+  format::pack::string(writer, "abc");
+  format::pack::string(writer, std::string(40, 'x'));
+  format::pack::array(writer, 16);
+  ASSERT_EQ(writer.release(), std::string("\x92\xa3" "abc" "\xd9\x28", 7) + std::string(40, 'x') + std::string("\xdc\x00\x10", 3));
+}
+
+TEST(Pack, models) {
+  format::writer writer;
+  writer << format::msgpack{Quick{1, 2.5f}};
+  ASSERT_EQ(writer.release(), std::string("\x92\x01\xca\x40\x20\x00\x00", 7));
+
+  writer << format::msgpack{Skull{1, "a", "b", "c", 1.0f, {}}};
+  ASSERT_EQ(writer.release(), std::string("\x96\x01\xa1" "a" "\xa1" "b" "\xa1" "c" "\xca\x3f\x80\x00\x00\xc0", 14));
+
+  const Occurrence occurrence{70000, 2, 3.2f, 4};
+  format::counter counter;
+  counter << format::msgpack{occurrence};
+  writer << format::msgpack{occurrence};
+  ASSERT_EQ(writer.release(), std::string("\x94\xce\x00\x01\x11\x70\x02\xca\x40\x4c\xcc\xcd\x04", 13));
+  ASSERT_EQ(counter.size(), 13);
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <cstring>
+
 #include "model.hpp"
 #include "user.hpp"
 
@@ -18,13 +20,21 @@ TEST(Skull, tsv) {
 }
 
 TEST(Skull, from) {
-  Skull skull{std::array<std::string_view, Skull::size>{"1", "nome", "cor", "icone", "2", "_"}};
-  ASSERT_EQ(skull.id(), 1);
-  ASSERT_EQ(skull.name(), "nome");
-  ASSERT_EQ(skull.color(), "cor");
-  ASSERT_EQ(skull.icon(), "icone");
-  ASSERT_EQ(skull.unitPrice(), 2.0f);
-  ASSERT_EQ(skull.limit(), std::nullopt);
+  std::size_t field;
+  auto skull = Skull::parse({"1", "nome", "cor", "icone", "2", "_"}, field);
+  ASSERT_TRUE(skull);
+  ASSERT_EQ(skull->id(), 1);
+  ASSERT_EQ(skull->name(), "nome");
+  ASSERT_EQ(skull->color(), "cor");
+  ASSERT_EQ(skull->icon(), "icone");
+  ASSERT_EQ(skull->unitPrice(), 2.0f);
+  ASSERT_EQ(skull->limit(), std::nullopt);
+}
+
+TEST(Skull, from_malformed) {
+  std::size_t field;
+  ASSERT_FALSE(Skull::parse({"1", "nome", "cor", "icone", "2", "lots"}, field));
+  ASSERT_EQ(field, 5);
 }
 
 TEST(Quick, json) {
@@ -42,9 +52,24 @@ TEST(Quick, tsv) {
 }
 
 TEST(Quick, from) {
-  Quick quick{std::array<std::string_view, Quick::size>{"1", "2"}};
-  ASSERT_EQ(quick.skull(), 1);
-  ASSERT_EQ(quick.amount(), 2.0f);
+  std::size_t field;
+  auto quick = Quick::parse({"1", "2"}, field);
+  ASSERT_TRUE(quick);
+  ASSERT_EQ(quick->skull(), 1);
+  ASSERT_EQ(quick->amount(), 2.0f);
+}
+
+TEST(Quick, binary) {
+  Quick quick{1, 2.5};
+  std::stringstream stream;
+  quick.binary(stream);
+  ASSERT_EQ(stream.str().size(), sizeof(Quick::Record));
+
+  Quick::Record record;
+  std::memcpy(&record, stream.str().data(), sizeof(Quick::Record));
+  Quick loaded{record};
+  ASSERT_EQ(loaded.skull(), 1);
+  ASSERT_EQ(loaded.amount(), 2.5f);
 }
 
 TEST(Occurrence, json) {
@@ -62,11 +87,60 @@ TEST(Occurrence, tsv) {
 }
 
 TEST(Occurrence, from) {
-  Occurrence occurrence{std::array<std::string_view, Occurrence::size>{"1", "2", "3.2", "4"}};
-  ASSERT_EQ(occurrence.id(), 1);
-  ASSERT_EQ(occurrence.skull(), 2);
-  ASSERT_EQ(occurrence.amount(), 3.2f);
-  ASSERT_EQ(occurrence.millis(), 4);
+  std::size_t field;
+  auto occurrence = Occurrence::parse({"1", "2", "3.2", "4"}, field);
+  ASSERT_TRUE(occurrence);
+  ASSERT_EQ(occurrence->id(), 1);
+  ASSERT_EQ(occurrence->skull(), 2);
+  ASSERT_EQ(occurrence->amount(), 3.2f);
+  ASSERT_EQ(occurrence->millis(), 4);
+}
+
+TEST(Occurrence, from_malformed) {
+  std::size_t field;
+  ASSERT_FALSE(Occurrence::parse({"1", "5000000000", "3.2", "4"}, field));
+  ASSERT_EQ(field, 1);
+  ASSERT_FALSE(Occurrence::parse({"1", "2", "3.2", "4x"}, field));
+  ASSERT_EQ(field, 3);
+}
+
+TEST(Occurrence, binary) {
+  Occurrence occurrence{1, 2, 3.2, 4};
+  std::stringstream stream;
+  occurrence.binary(stream);
+  ASSERT_EQ(stream.str().size(), sizeof(Occurrence::Record));
+
+  Occurrence::Record record;
+  std::memcpy(&record, stream.str().data(), sizeof(Occurrence::Record));
+  Occurrence loaded{record};
+  ASSERT_EQ(loaded.id(), 1);
+  ASSERT_EQ(loaded.skull(), 2);
+  ASSERT_EQ(loaded.amount(), 3.2f);
+  ASSERT_EQ(loaded.millis(), 4);
+}
+
+TEST(Occurrence, wide_ids) {
+  std::size_t field;
+  const auto occurrence = Occurrence::parse({"70000", "80000", "3.2", "4"}, field);
+  ASSERT_TRUE(occurrence);
+
+  std::stringstream stream;
+  occurrence->binary(stream);
+
+  Occurrence::Record record;
+  std::memcpy(&record, stream.str().data(), sizeof(Occurrence::Record));
+  Occurrence loaded{record};
+  ASSERT_EQ(loaded.id(), 70000);
+  ASSERT_EQ(loaded.skull(), 80000);
+}
+
+TEST(Occurrence, legacy_record) {
+  const Occurrence::LegacyRecord record{4, 3.2f, 1, 2};
+  Occurrence loaded{record};
+  ASSERT_EQ(loaded.id(), 1);
+  ASSERT_EQ(loaded.skull(), 2);
+  ASSERT_EQ(loaded.amount(), 3.2f);
+  ASSERT_EQ(loaded.millis(), 4);
 }
 
 TEST(User, keeps_name_reference) {
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "parser.hpp"
+
+TEST(Parser, find) {
+  std::string buffer(100, 'a');
+  buffer[77] = '\t';
+
+  ASSERT_EQ(parser::find(buffer.data(), buffer.data() + buffer.size(), '\t'), buffer.data() + 77);
+  ASSERT_EQ(parser::find(buffer.data(), buffer.data() + 77, '\t'), buffer.data() + 77);
+  ASSERT_EQ(parser::find(buffer.data(), buffer.data() + buffer.size(), '\n'), buffer.data() + buffer.size());
+}
+
+TEST(Parser, lines) {
+  std::vector<std::pair<std::string, std::size_t>> lines;
+  parser::forEachLine("first\n\nthird\r\nfourth", [&](std::string_view line, std::size_t number) {
+    lines.emplace_back(line, number);
+  });
+
+  ASSERT_EQ(lines.size(), 3);
+  ASSERT_EQ(lines[0], std::make_pair(std::string{"first"}, std::size_t{1}));
+  ASSERT_EQ(lines[1], std::make_pair(std::string{"third"}, std::size_t{3}));
+  ASSERT_EQ(lines[2], std::make_pair(std::string{"fourth"}, std::size_t{4}));
+}
+
+TEST(Parser, parse) {
+  std::size_t column{0};
+  auto occurrence = parser::parse<Occurrence>("1\t2\t3.2\t4", column);
+  ASSERT_TRUE(occurrence);
+  ASSERT_EQ(occurrence->id(), 1);
+  ASSERT_EQ(occurrence->skull(), 2);
+  ASSERT_EQ(occurrence->amount(), 3.2f);
+  ASSERT_EQ(occurrence->millis(), 4);
+}
+
+TEST(Parser, column) {
+  std::size_t column{0};
+
+  ASSERT_FALSE(parser::parse<Occurrence>("1\t2\tx\t4", column));
+  ASSERT_EQ(column, 5);
+
+  ASSERT_FALSE(parser::parse<Occurrence>("1\t2\t3", column));
+  ASSERT_EQ(column, 6);
+
+  ASSERT_FALSE(parser::parse<Quick>("1\t2\t3", column));
+  ASSERT_EQ(column, 4);
+}
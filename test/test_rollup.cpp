@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <vector>
+
+#include "rollup.hpp"
+
+namespace {
+  // 2020-09-13T12:26:40Z, a Sunday
+  constexpr const long SUNDAY = 1600000000000L;
+  constexpr const long DAY = 24L * 60 * 60 * 1000;
+}
+
+TEST(Rollup, buckets) {
+  ASSERT_EQ(Rollup::bucketOf(0, Granularity::Day), 0);
+  ASSERT_EQ(Rollup::bucketOf(-1, Granularity::Day), -1);
+  ASSERT_EQ(Rollup::startOf(Rollup::bucketOf(SUNDAY, Granularity::Day), Granularity::Day), 1599955200000L);
+
+  // Weeks start on Monday
+  const auto week = Rollup::bucketOf(SUNDAY, Granularity::Week);
+  ASSERT_EQ(Rollup::bucketOf(SUNDAY + DAY, Granularity::Week), week + 1);
+  ASSERT_EQ(Rollup::startOf(week + 1, Granularity::Week), 1599955200000L + DAY);
+
+  const auto month = Rollup::bucketOf(SUNDAY, Granularity::Month);
+  ASSERT_EQ(month, 2020 * 12 + 8);
+  ASSERT_EQ(Rollup::startOf(month, Granularity::Month), 1598918400000L);
+  ASSERT_EQ(Rollup::startOf(month + 4, Granularity::Month), 1609459200000L);
+  ASSERT_EQ(Rollup::bucketOf(-1, Granularity::Month), 1969 * 12 + 11);
+}
+
+TEST(Rollup, parse) {
+  ASSERT_EQ(Rollup::parse("day"), Granularity::Day);
+  ASSERT_EQ(Rollup::parse("week"), Granularity::Week);
+  ASSERT_EQ(Rollup::parse("month"), Granularity::Month);
+  ASSERT_FALSE(Rollup::parse("year"));
+}
+
+TEST(Rollup, totals) {
+  Rollup rollup;
+  rollup.add({1, 1, 1.5f, SUNDAY});
+  rollup.add({2, 1, 2.0f, SUNDAY + 1000});
+  rollup.add({3, 2, 1.0f, SUNDAY + DAY});
+  rollup.add({4, 1, 0.5f, SUNDAY + 2 * DAY});
+  rollup.remove({2, 1, 2.0f, SUNDAY + 1000});
+
+  struct Row {
+    std::int64_t bucket;
+    std::uint32_t skull;
+    double amount;
+    std::uint32_t count;
+  };
+  const auto collect = [&rollup](Granularity granularity, long from, long to, std::optional<std::uint32_t> skull) {
+    std::vector<Row> rows;
+    rollup.forEach(granularity, from, to, skull, [&rows](auto bucket, auto id, const auto & total) {
+      rows.push_back({bucket, id, total.amount, total.count});
+    });
+    return rows;
+  };
+
+  const auto days = collect(Granularity::Day, SUNDAY, SUNDAY + 3 * DAY, 1);
+  ASSERT_EQ(days.size(), 2);
+  ASSERT_EQ(days[0].amount, 1.5);
+  ASSERT_EQ(days[0].count, 1);
+  ASSERT_EQ(days[1].bucket, days[0].bucket + 2);
+  ASSERT_EQ(days[1].amount, 0.5);
+
+  // The range is exclusive at the end but covers whole buckets
+  ASSERT_EQ(collect(Granularity::Day, SUNDAY + 1000, 1599955200000L + DAY, {}).size(), 1);
+  ASSERT_TRUE(collect(Granularity::Day, SUNDAY, SUNDAY, {}).empty());
+
+  const auto weeks = collect(Granularity::Week, SUNDAY, SUNDAY + 3 * DAY, 1);
+  ASSERT_EQ(weeks.size(), 2);
+  ASSERT_EQ(weeks[1].amount, 0.5);
+
+  const auto months = collect(Granularity::Month, 0, SUNDAY + 3 * DAY, {});
+  ASSERT_EQ(months.size(), 2);
+
+  // Open ranges span every representable millis
+  constexpr const auto MIN = std::numeric_limits<long>::min();
+  constexpr const auto MAX = std::numeric_limits<long>::max();
+  ASSERT_EQ(collect(Granularity::Day, MIN, MAX, {}).size(), 3);
+  ASSERT_EQ(collect(Granularity::Week, MIN, MAX, {}).size(), 3);
+  ASSERT_EQ(collect(Granularity::Month, MIN, MAX, {}).size(), 2);
+
+  rollup.remove({1, 1, 1.5f, SUNDAY});
+  rollup.remove({3, 2, 1.0f, SUNDAY + DAY});
+  rollup.remove({4, 1, 0.5f, SUNDAY + 2 * DAY});
+  ASSERT_EQ(rollup.size(), 0);
+}
@@ -2,6 +2,8 @@
 
 #include <iostream>
 
+#include "etag.hpp"
+
 TEST(StreamResponse, size_watcher) {
   std::stringstream stream;
 
@@ -17,3 +19,29 @@ TEST(StreamResponse, size_watcher) {
   stream << "this is another another string";
   ASSERT_EQ(stream.tellp(), 30);
 }
+
+TEST(EntityTag, matches_if_none_match) {
+  const auto tag = R"("5f-2a-msgpack")";
+
+  ASSERT_TRUE(etag::matches(R"("5f-2a-msgpack")", tag));
+  ASSERT_FALSE(etag::matches(R"("5f-2a")", tag));
+  ASSERT_FALSE(etag::matches("", tag));
+
+  // Lists, with or without whitespace around the commas
+  ASSERT_TRUE(etag::matches(R"("5f-29", "5f-2a-msgpack")", tag));
+  ASSERT_TRUE(etag::matches("\"5f-29\",\t\"5f-2a-msgpack\"\t", tag));
+  ASSERT_TRUE(etag::matches(R"("5f-29","5f-2a-msgpack","5f-2b")", tag));
+  ASSERT_FALSE(etag::matches(R"("5f-29", "5f-2b")", tag));
+  ASSERT_FALSE(etag::matches(" , ,", tag));
+
+  // Weak tags compare by their opaque part, and only the prefix makes one weak
+  ASSERT_TRUE(etag::matches(R"(W/"5f-2a-msgpack")", tag));
+  ASSERT_TRUE(etag::matches(R"("5f-29", W/"5f-2a-msgpack")", tag));
+  ASSERT_FALSE(etag::matches(R"(w/"5f-2a-msgpack")", tag));
+  ASSERT_FALSE(etag::matches(R"(5f-2a-msgpack)", tag));
+
+  // A wildcard matches any representation, but only on its own
+  ASSERT_TRUE(etag::matches("*", tag));
+  ASSERT_TRUE(etag::matches(" * ", tag));
+  ASSERT_FALSE(etag::matches(R"("*")", tag));
+}
@@ -0,0 +1,396 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <spdlog/spdlog.h>
+
+#include "storage.hpp"
+
+namespace {
+  constexpr const auto USER = "test-storage";
+
+  // Every test gets a data root of its own in the temporary directory, holding one user
+  class StorageTest : public testing::Test {
+  protected:
+    const User user{USER};
+    const boost::filesystem::path data{boost::filesystem::temp_directory_path()
+                                       / boost::filesystem::unique_path("skull-test-%%%%-%%%%-%%%%")};
+    const boost::filesystem::path root{data / USER};
+
+    void SetUp() override {
+      spdlog::set_level(spdlog::level::warn);
+      boost::filesystem::create_directories(root);
+      std::ofstream{(root / constant::file::SKULL).string()};
+    }
+
+    void TearDown() override {
+      boost::filesystem::remove_all(data);
+    }
+
+    // Every run loads the user from disk, and the writer is joined on the way out so
+    // mutations are on disk after
+    template <typename F>
+    void run(F && function,
+             Durability durability = Durability::None,
+             std::chrono::milliseconds flushLatency = constant::storage::FLUSH_LATENCY) {
+      Storage storage{data.string()};
+      storage.start(std::size_t{1} << 30, durability, flushLatency);
+      const auto pin = storage.pin(user);
+      ASSERT_TRUE(pin);
+      function(storage);
+    }
+  };
+}
+
+TEST_F(StorageTest, replays_duplicate_quicks) {
+  run([this](Storage & storage) {
+    storage.add(user, Quick{1, 1.5f});
+    storage.add(user, Quick{1, 1.5f});
+  });
+
+  // The first run replays the journal and compacts it, the second reads the snapshot
+  for (auto i = 0; i < 2; ++i) {
+    run([this](Storage & storage) {
+      ASSERT_EQ(storage.get<Quick>(user), R"([{"skull":1,"amount":1.5},{"skull":1,"amount":1.5}])");
+    });
+  }
+}
+
+TEST_F(StorageTest, keeps_journal_when_snapshot_fails) {
+  run([this](Storage & storage) { storage.add(user, Quick{1, 1.5f}); });
+
+  // A directory in place of the temporary file makes the snapshot fail to open
+  const auto blocker = root / (std::string{constant::file::binary::QUICK} + ".tmp");
+  boost::filesystem::create_directories(blocker);
+  run([this](Storage & storage) { ASSERT_EQ(storage.get<Quick>(user), R"([{"skull":1,"amount":1.5}])"); });
+  ASSERT_FALSE(boost::filesystem::exists(root / constant::file::binary::QUICK));
+  ASSERT_GT(boost::filesystem::file_size(root / constant::file::journal::QUICK), 0);
+
+  boost::filesystem::remove_all(blocker);
+  run([this](Storage & storage) { ASSERT_EQ(storage.get<Quick>(user), R"([{"skull":1,"amount":1.5}])"); });
+  ASSERT_EQ(boost::filesystem::file_size(root / constant::file::journal::QUICK), 0);
+}
+
+TEST_F(StorageTest, migrates_legacy_occurrences_to_segments) {
+  std::ofstream{(root / constant::file::OCCURRENCE).string()} << "1\t1\t1.5\t1600000000000\n"
+                                                               << "2\t1\t2\t1610000000000\n";
+
+  // Leftovers of a migration that crashed halfway must not end up in the segments
+  boost::filesystem::create_directories(root / constant::file::staging::OCCURRENCE);
+  std::ofstream{(root / constant::file::staging::OCCURRENCE / "2020-09.bin").string()} << "partial";
+
+  const auto expected = R"([{"id":1,"skull":1,"amount":1.5,"millis":1600000000000},)"
+                        R"({"id":2,"skull":1,"amount":2,"millis":1610000000000}])";
+  for (auto i = 0; i < 2; ++i) {
+    run([this, expected](Storage & storage) { ASSERT_EQ(storage.get<Occurrence>(user), expected); });
+  }
+
+  const auto segments = root / constant::file::segment::OCCURRENCE;
+  ASSERT_TRUE(boost::filesystem::exists(segments / "2020-09.bin"));
+  ASSERT_TRUE(boost::filesystem::exists(segments / "2021-01.bin"));
+  ASSERT_FALSE(boost::filesystem::exists(root / constant::file::staging::OCCURRENCE));
+  ASSERT_FALSE(boost::filesystem::exists(root / constant::file::OCCURRENCE));
+  ASSERT_TRUE(boost::filesystem::exists(root / constant::file::migrated::OCCURRENCE));
+}
+
+TEST_F(StorageTest, reloads_while_waiting_for_durability) {
+  constexpr const std::size_t ADDS = 200;
+
+  run([this](Storage & storage) {
+    std::atomic<bool> adding{true};
+    std::thread reloader{[&] {
+      while (adding) storage.reload(user);
+    }};
+
+    // Reloads flush the queue, which must still wake the writes waiting on it
+    for (std::size_t i = 0; i < ADDS; ++i) {
+      storage.add(user, Occurrence{storage.nextId<Occurrence>(user), 1, 1.0f, 1600000000000L + static_cast<long>(i)});
+    }
+    adding = false;
+    reloader.join();
+  }, Durability::EveryWrite);
+
+  run([this, ADDS](Storage & storage) { ASSERT_EQ(storage.snapshot<Occurrence>(user)->size(), ADDS); });
+}
+
+TEST_F(StorageTest, skips_unfinished_segments) {
+  // The second run compacts the journal into the segment
+  run([this](Storage & storage) { storage.add(user, Occurrence{1, 1, 1.5f, 1600000000000}); });
+  run([](Storage &) {});
+
+  // A snapshot interrupted by a crash holds the same entries as the segment it replaces
+  const auto segments = root / constant::file::segment::OCCURRENCE;
+  const auto temporary = segments / "2020-09.bin.tmp";
+  boost::filesystem::copy_file(segments / "2020-09.bin", temporary);
+
+  run([this](Storage & storage) {
+    ASSERT_EQ(storage.get<Occurrence>(user), R"([{"id":1,"skull":1,"amount":1.5,"millis":1600000000000}])");
+  });
+  ASSERT_FALSE(boost::filesystem::exists(temporary));
+}
+
+TEST_F(StorageTest, reloads_without_losing_queued_mutations) {
+  constexpr const std::size_t WRITERS = 4;
+  constexpr const std::size_t ADDS = 2000;
+
+  run([this, WRITERS, ADDS](Storage & storage) {
+    std::atomic<bool> adding{true};
+    std::thread reloader{[&] {
+      while (adding) storage.reload(user);
+    }};
+
+    // Concurrent mutations push reloads onto their fallback, which reads under the lock
+    std::vector<std::thread> writers;
+    for (std::size_t writer = 0; writer < WRITERS; ++writer) {
+      writers.emplace_back([&] {
+        for (std::size_t i = 0; i < ADDS; ++i) {
+          storage.add(user, Occurrence{storage.nextId<Occurrence>(user), 1, 1.0f, 1600000000000L + static_cast<long>(i)});
+        }
+      });
+    }
+    for (auto & writer : writers) writer.join();
+    adding = false;
+    reloader.join();
+
+    ASSERT_EQ(storage.snapshot<Occurrence>(user)->size(), WRITERS * ADDS);
+  });
+}
+
+TEST_F(StorageTest, rolls_up_open_ranges) {
+  run([this](Storage & storage) {
+    storage.add(user, Occurrence{1, 1, 1.5f, 1600000000000});
+
+    // What /rollup asks for when neither from nor to is given
+    const auto rows = storage.rollup(user,
+                                     Granularity::Day,
+                                     std::numeric_limits<long>::min(),
+                                     std::numeric_limits<long>::max(),
+                                     {});
+    ASSERT_EQ(rows, R"([{"start":1599955200000,"skull":1,"amount":1.5,"count":1,"value":0}])");
+  });
+}
+
+TEST_F(StorageTest, buckets_series_on_calendar_edges) {
+  run([this](Storage & storage) {
+    // The last millisecond of a Sunday and of January, and the first of the next Monday
+    // and of February
+    storage.add(user, Occurrence{1, 1, 1.0f, 1706486399999});
+    storage.add(user, Occurrence{2, 1, 2.0f, 1706486400000});
+    storage.add(user, Occurrence{3, 1, 4.0f, 1706745599999});
+    storage.add(user, Occurrence{4, 1, 8.0f, 1706745600000});
+    storage.add(user, Occurrence{5, 2, 16.0f, 1706529600000});
+
+    ASSERT_EQ(storage.series(user, {}, Granularity::Day),
+              R"([{"start":1706400000000,"amount":1,"count":1},)"
+              R"({"start":1706486400000,"amount":18,"count":2},)"
+              R"({"start":1706659200000,"amount":4,"count":1},)"
+              R"({"start":1706745600000,"amount":8,"count":1}])");
+    ASSERT_EQ(storage.series(user, {}, Granularity::Week),
+              R"([{"start":1705881600000,"amount":1,"count":1},)"
+              R"({"start":1706486400000,"amount":30,"count":4}])");
+    ASSERT_EQ(storage.series(user, {}, Granularity::Month),
+              R"([{"start":1704067200000,"amount":23,"count":4},)"
+              R"({"start":1706745600000,"amount":8,"count":1}])");
+
+    // The end of a range is exclusive, and a skull narrows it down
+    Storage::Range range;
+    range.from = 1706486400000;
+    range.to = 1706745600000;
+    ASSERT_EQ(storage.series(user, range, Granularity::Day),
+              R"([{"start":1706486400000,"amount":18,"count":2},)"
+              R"({"start":1706659200000,"amount":4,"count":1}])");
+    range.skull = 2;
+    ASSERT_EQ(storage.series(user, range, Granularity::Month),
+              R"([{"start":1704067200000,"amount":16,"count":1}])");
+    range.to = 1706529600000;
+    ASSERT_EQ(storage.series(user, range, Granularity::Day), "[]");
+
+    // Buckets before the epoch round down rather than towards zero
+    storage.add(user, Occurrence{6, 1, 1.0f, -1});
+    range = {};
+    range.to = 0;
+    ASSERT_EQ(storage.series(user, range, Granularity::Day), R"([{"start":-86400000,"amount":1,"count":1}])");
+    ASSERT_EQ(storage.series(user, range, Granularity::Week), R"([{"start":-259200000,"amount":1,"count":1}])");
+  });
+}
+
+TEST_F(StorageTest, removes_occurrences_by_id) {
+  run([this](Storage & storage) {
+    for (std::uint32_t id = 1; id <= 3; ++id) {
+      storage.add(user, Occurrence{id, 1, 1.0f, 1600000000000L + id});
+    }
+
+    // Only the id is looked up, the other fields need not match
+    ASSERT_TRUE(storage.remove(user, Occurrence{2, 0, 0, 0}));
+    ASSERT_FALSE(storage.remove(user, Occurrence{2, 0, 0, 0}));
+    ASSERT_FALSE(storage.remove(user, Occurrence{4, 0, 0, 0}));
+  });
+
+  // The index is rebuilt from the files on load
+  run([this](Storage & storage) {
+    ASSERT_TRUE(storage.remove(user, Occurrence{3, 0, 0, 0}));
+    ASSERT_EQ(storage.get<Occurrence>(user), R"([{"id":1,"skull":1,"amount":1,"millis":1600000000001}])");
+  });
+}
+
+TEST_F(StorageTest, pages_through_occurrences) {
+  run([this](Storage & storage) {
+    // Two share their millis, which ids break the tie of
+    storage.add(user, Occurrence{1, 1, 1.0f, 1000});
+    storage.add(user, Occurrence{2, 2, 1.0f, 2000});
+    storage.add(user, Occurrence{3, 1, 1.0f, 2000});
+    storage.add(user, Occurrence{4, 2, 1.0f, 3000});
+    storage.add(user, Occurrence{5, 1, 1.0f, 4000});
+    storage.remove(user, Occurrence{4, 0, 0, 0});
+
+    Storage::Range range;
+    range.limit = 2;
+    auto page = storage.page<Occurrence>(user, range, false);
+    ASSERT_EQ(page.body, R"([{"id":1,"skull":1,"amount":1,"millis":1000},{"id":2,"skull":2,"amount":1,"millis":2000}])");
+    ASSERT_TRUE(page.next);
+    ASSERT_EQ(page.next->millis, 2000);
+    ASSERT_EQ(page.next->id, 2);
+
+    // Removed values are skipped, and the last page has no cursor
+    range.after = page.next;
+    page = storage.page<Occurrence>(user, range, false);
+    ASSERT_EQ(page.body, R"([{"id":3,"skull":1,"amount":1,"millis":2000},{"id":5,"skull":1,"amount":1,"millis":4000}])");
+    ASSERT_FALSE(page.next);
+
+    // From is inclusive and to is exclusive
+    Storage::Range window;
+    window.from = 2000;
+    window.to = 4000;
+    page = storage.page<Occurrence>(user, window, false);
+    ASSERT_EQ(page.body, R"([{"id":2,"skull":2,"amount":1,"millis":2000},{"id":3,"skull":1,"amount":1,"millis":2000}])");
+
+    // A cursor before from does not rewind past it
+    Storage::Range skull;
+    skull.from = 1500;
+    skull.skull = 1;
+    skull.after = Storage::Cursor{1000, 1};
+    page = storage.page<Occurrence>(user, skull, false);
+    ASSERT_EQ(page.body, R"([{"id":3,"skull":1,"amount":1,"millis":2000},{"id":5,"skull":1,"amount":1,"millis":4000}])");
+  });
+}
+
+TEST_F(StorageTest, sends_changes_since_a_sequence) {
+  const auto sequenceOf = [](const std::string & changes) {
+    return std::stoull(changes.substr(std::char_traits<char>::length(R"({"sequence":)")));
+  };
+
+  run([this, &sequenceOf](Storage & storage) {
+    // Without a sequence there is nothing to start from
+    const auto start = sequenceOf(storage.changes(user, {}));
+    ASSERT_EQ(storage.changes(user, {}), R"({"sequence":)" + std::to_string(start) + R"(,"reset":true})");
+
+    storage.add(user, Quick{1, 1.5f});
+    storage.add(user, Occurrence{1, 1, 1.5f, 1000});
+
+    const auto quick = R"({"sequence":)" + std::to_string(start + 1)
+                       + R"(,"type":"quick","operation":"add","value":{"skull":1,"amount":1.5}})";
+    const auto occurrence = R"({"sequence":)" + std::to_string(start + 2)
+                            + R"(,"type":"occurrence","operation":"add","value":{"id":1,"skull":1,"amount":1.5,"millis":1000}})";
+    const auto latest = R"({"sequence":)" + std::to_string(start + 2) + R"(,"reset":false,"changes":[)";
+    ASSERT_EQ(storage.changes(user, start), latest + quick + ',' + occurrence + "]}");
+    ASSERT_EQ(storage.changes(user, start + 1), latest + occurrence + "]}");
+    ASSERT_EQ(storage.changes(user, start + 2), latest + "]}");
+
+    // Sequences from before the first retained change or from the future are unknown
+    ASSERT_EQ(storage.changes(user, start - 1), R"({"sequence":)" + std::to_string(start + 2) + R"(,"reset":true})");
+    ASSERT_EQ(storage.changes(user, start + 3), R"({"sequence":)" + std::to_string(start + 2) + R"(,"reset":true})");
+
+    // Reloading drops every change, since the files may hold others
+    storage.reload(user);
+    ASSERT_EQ(storage.changes(user, start + 2), R"({"sequence":)" + std::to_string(start + 3) + R"(,"reset":true})");
+    ASSERT_EQ(storage.changes(user, start + 3), R"({"sequence":)" + std::to_string(start + 3) + R"(,"reset":false,"changes":[]})");
+  });
+}
+
+TEST_F(StorageTest, compacts_only_what_was_journaled) {
+  constexpr const std::size_t ROUNDS = 5;
+  constexpr const std::size_t WRITERS = 8;
+  constexpr const std::size_t ADDS = 5000;
+
+  // Without latency every batch is small, so writers keep adding while one is journaled and
+  // whatever follows the last compaction stays in the journal. Interleavings vary, hence
+  // the rounds
+  for (std::size_t round = 1; round <= ROUNDS; ++round) {
+    run([this, WRITERS, ADDS](Storage & storage) {
+      std::vector<std::thread> writers;
+      for (std::size_t writer = 0; writer < WRITERS; ++writer) {
+        writers.emplace_back([&] {
+          for (std::size_t i = 0; i < ADDS; ++i) storage.add(user, Quick{1, 1.5f});
+        });
+      }
+      for (auto & writer : writers) writer.join();
+    }, Durability::None, std::chrono::milliseconds{0});
+
+    run([this, round, WRITERS, ADDS](Storage & storage) {
+      ASSERT_EQ(storage.snapshot<Quick>(user)->size(), round * WRITERS * ADDS);
+    });
+  }
+}
+
+TEST_F(StorageTest, drops_unterminated_journal_entries) {
+  // A crash mid-append leaves a prefix which would parse as an occurrence of 1970
+  std::ofstream{(root / constant::file::journal::OCCURRENCE).string()} << "+\t1\t1\t1.5\t1600000000000\n"
+                                                                        << "+\t7\t1\t12.5\t16000";
+
+  const auto expected = R"([{"id":1,"skull":1,"amount":1.5,"millis":1600000000000}])";
+  for (auto i = 0; i < 2; ++i) {
+    run([this, expected](Storage & storage) { ASSERT_EQ(storage.get<Occurrence>(user), expected); });
+  }
+  ASSERT_EQ(boost::filesystem::file_size(root / constant::file::journal::OCCURRENCE), 0);
+}
+
+TEST_F(StorageTest, fails_writes_that_miss_the_journal) {
+  // A directory in place of the journal makes every append fail
+  boost::filesystem::create_directories(root / constant::file::journal::QUICK);
+
+  run([this](Storage & storage) {
+    ASSERT_FALSE(storage.add(user, Quick{1, 1.5f}));
+    ASSERT_TRUE(storage.add(user, Occurrence{storage.nextId<Occurrence>(user), 1, 1.5f, 1600000000000}));
+  }, Durability::EveryWrite);
+}
+
+TEST_F(StorageTest, serializes_snapshots_a_piece_at_a_time) {
+  run([this](Storage & storage) {
+    for (std::uint32_t id = 1; id <= 50; ++id) {
+      storage.add(user, Occurrence{id, 1, 1.5f, 1600000000000L + id});
+    }
+    storage.remove(user, Occurrence{1, 0, 0, 0});
+    storage.remove(user, Occurrence{50, 0, 0, 0});
+
+    for (const auto packed : {false, true}) {
+      Storage::Serializer<Occurrence> serializer{storage.snapshot<Occurrence>(user), packed};
+      std::string body;
+      auto pieces = 0;
+      while (true) {
+        format::writer piece;
+        const auto last = serializer(piece, 100);
+        body += piece.view();
+        ++pieces;
+        if (last) break;
+        ASSERT_GE(piece.size(), 100);
+      }
+
+      ASSERT_GT(pieces, 5);
+      ASSERT_EQ(body, packed ? storage.msgpack<Occurrence>(user) : storage.get<Occurrence>(user));
+    }
+
+    // Even when there is nothing to serialize
+    for (const auto packed : {false, true}) {
+      format::writer empty;
+      ASSERT_TRUE((Storage::Serializer<Skull>{storage.snapshot<Skull>(user), packed}(empty, 100)));
+      ASSERT_EQ(empty.view(), packed ? storage.msgpack<Skull>(user) : "[]");
+    }
+  });
+}